@@ -0,0 +1,485 @@
+/*
+ * Runs a command on a local pseudo-terminal and measures its output behind a
+ * simulated network link, see README.md in this directory.
+ *
+ * The command marks its progress with APC strings that are not counted as
+ * payload:
+ *
+ *     ESC _ ncbench:ready ESC \          - setup finished, input may be sent
+ *     ESC _ ncbench:frame ESC \          - a frame was completely written
+ *     ESC _ ncbench:echo ESC \           - the oldest unanswered input was echoed
+ *     ESC _ ncbench:syscalls:<n> ESC \   - number of read/write system calls
+ */
+#define _XOPEN_SOURCE 600
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/* -------------------------------------------------------------------------------------------- */
+
+#define MARKER      "ncbench:"
+#define MARKER_MAX  64
+#define READ_SIZE   16384
+
+typedef struct Chunk
+{
+    struct Chunk* next;
+    double        due;       /* arrival time at the other end of the link */
+    size_t        len;
+    size_t        pos;       /* bytes already written to the pty */
+    char          data[];
+} Chunk;
+
+typedef struct Link
+{
+    Chunk*        first;
+    Chunk*        last;
+    size_t        inflight;  /* bytes sent but not yet delivered */
+    double        busy;      /* time when the last chunk is completely sent */
+} Link;
+
+static double bandwidth = 0;     /* bytes per second, 0 means unlimited */
+static double latency   = 0;     /* seconds, per direction */
+
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void die(const char* what)
+{
+    perror(what);
+    exit(2);
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+static void link_send(Link* link, const char* data, size_t len, double t)
+{
+    Chunk* c = (Chunk*) malloc(sizeof(Chunk) + len);
+    if (!c) {
+        die("malloc");
+    }
+    memcpy(c->data, data, len);
+    c->next = NULL;
+    c->len  = len;
+    c->pos  = 0;
+    /* chunks are serialised at the given bandwidth, then travel for the latency */
+    double start = (t > link->busy) ? t : link->busy;
+    link->busy = start + ((bandwidth > 0) ? len / bandwidth : 0);
+    c->due = link->busy + latency;
+    if (link->last) {
+        link->last->next = c;
+    } else {
+        link->first = c;
+    }
+    link->last      = c;
+    link->inflight += len;
+}
+
+static Chunk* link_peek(Link* link, double t)
+{
+    return (link->first && link->first->due <= t) ? link->first : NULL;
+}
+
+static void link_pop(Link* link)
+{
+    Chunk* c = link->first;
+    link->first = c->next;
+    if (!link->first) {
+        link->last = NULL;
+    }
+    link->inflight -= c->len;
+    free(c);
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+typedef struct Stats
+{
+    double  start;           /* ready marker received */
+    double  end;             /* last frame marker received */
+    long    frames;
+    size_t  bytes;           /* payload without markers */
+    size_t  markerbytes;
+    long    syscalls;        /* -1 if not reported */
+    double* latencies;       /* input-to-echo in seconds */
+    long    nlatencies;
+    long    caplatencies;
+} Stats;
+
+static Stats   stats = { 0, 0, 0, 0, 0, -1, NULL, 0, 0 };
+static bool    ready = false;
+
+static double* pending  = NULL;  /* send times of unanswered input, FIFO */
+static long    npending = 0;
+static long    headpending = 0;
+
+static int     pstate = 0;       /* 0 = text, 1 = ESC, 2 = APC, 3 = ESC in APC */
+static char    apc[MARKER_MAX];
+static size_t  apclen = 0;
+
+static void handleMarker(const char* m, double t)
+{
+    if (strcmp(m, "ready") == 0) {
+        ready       = true;
+        stats.start = t;
+    }
+    else if (strcmp(m, "frame") == 0) {
+        stats.frames += 1;
+        stats.end     = t;
+    }
+    else if (strcmp(m, "echo") == 0) {
+        if (headpending < npending) {
+            if (stats.nlatencies == stats.caplatencies) {
+                stats.caplatencies = stats.caplatencies ? 2 * stats.caplatencies : 256;
+                stats.latencies = (double*) realloc(stats.latencies,
+                                                    stats.caplatencies * sizeof(double));
+                if (!stats.latencies) {
+                    die("realloc");
+                }
+            }
+            stats.latencies[stats.nlatencies++] = t - pending[headpending++];
+        }
+    }
+    else if (strncmp(m, "syscalls:", 9) == 0) {
+        stats.syscalls = atol(m + 9);
+    }
+}
+
+static void parseOutput(const char* data, size_t len, double t)
+{
+    stats.bytes += len;
+    for (size_t i = 0; i < len; ++i) {
+        char c = data[i];
+        switch (pstate) {
+            case 0: if (c == '\033') pstate = 1;
+                    break;
+            case 1: if (c == '_') { pstate = 2; apclen = 0; }
+                    else if (c != '\033') pstate = 0;
+                    break;
+            case 2: if (c == '\033') pstate = 3;
+                    else if (apclen < MARKER_MAX - 1) apc[apclen++] = c;
+                    break;
+            case 3: if (c == '\\') {
+                        pstate = 0;
+                        apc[apclen] = '\0';
+                        if (strncmp(apc, MARKER, strlen(MARKER)) == 0) {
+                            stats.markerbytes += apclen + 4;
+                            handleMarker(apc + strlen(MARKER), t);
+                        }
+                    } else {
+                        pstate = (c == '_') ? 2 : 0;
+                        apclen = 0;
+                    }
+                    break;
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+static int compareDouble(const void* a, const void* b)
+{
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x < y) ? -1 : (x > y);
+}
+
+static void printHeader(void)
+{
+    printf("%-16s %8s %9s %12s %15s %9s %9s %9s %9s\n",
+           "workload", "frames", "fps", "bytes/frame", "syscalls/frame",
+           "echo avg", "p50", "p95", "max");
+}
+
+static void printReport(const char* name)
+{
+    long   frames  = stats.frames;
+    double elapsed = stats.end - stats.start;
+    size_t payload = stats.bytes - stats.markerbytes;
+    printf("%-16s %8ld", name, frames);
+    if (frames > 0 && elapsed > 0) {
+        printf(" %9.1f", frames / elapsed);
+    } else {
+        printf(" %9s", "-");
+    }
+    if (frames > 0) {
+        printf(" %12.1f", (double) payload / frames);
+    } else {
+        printf(" %12s", "-");
+    }
+    if (frames > 0 && stats.syscalls >= 0) {
+        printf(" %15.2f", (double) stats.syscalls / frames);
+    } else {
+        printf(" %15s", "-");
+    }
+    long n = stats.nlatencies;
+    if (n > 0) {
+        double* l = stats.latencies;
+        double  sum = 0;
+        qsort(l, n, sizeof(double), compareDouble);
+        for (long i = 0; i < n; ++i) {
+            sum += l[i];
+        }
+        printf(" %7.2fms %7.2fms %7.2fms %7.2fms",
+               1000 * sum / n, 1000 * l[n / 2], 1000 * l[(n * 95) / 100], 1000 * l[n - 1]);
+    } else {
+        printf(" %9s %9s %9s %9s", "-", "-", "-", "-");
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: ptybench [options] command [args...]\n"
+        "       ptybench -H\n"
+        "  -n name       workload name for the report\n"
+        "  -s COLSxROWS  terminal size, default 80x24\n"
+        "  -b bytes      link bandwidth in bytes per second, default unlimited\n"
+        "  -l ms         link latency per direction in milliseconds, default 0\n"
+        "  -w bytes      link window: output is not read from the pty while more bytes\n"
+        "                are in flight, default 65536\n"
+        "  -k n          send bursts of n keys after the ready marker\n"
+        "  -p bytes      send bracketed pastes of the given size after the ready marker\n"
+        "  -r n          number of key bursts or pastes, default 1; the next one is sent\n"
+        "                when all input was echoed, then Ctrl-D is sent\n"
+        "  -t seconds    kill the command after this time, default 60\n"
+        "  -H            print the report header and exit\n");
+    exit(2);
+}
+
+static const char* const keys[] = {
+    "a", "b", "c", "\033[A", "d", "e", "f", "\033[B", "g", "h", "\177", "\033[C"
+};
+
+static void sendInput(Link* in, int nkeys, int pastesize, double t)
+{
+    if (nkeys > 0) {
+        for (int i = 0; i < nkeys; ++i) {
+            const char* k = keys[i % (sizeof(keys) / sizeof(keys[0]))];
+            link_send(in, k, strlen(k), t);
+            pending[npending++] = t;
+        }
+    }
+    else {
+        char* paste = (char*) malloc(pastesize + 12);
+        if (!paste) {
+            die("malloc");
+        }
+        size_t len = 0;
+        memcpy(paste, "\033[200~", 6);
+        len += 6;
+        for (int i = 0; i < pastesize; ++i) {
+            paste[len++] = (i % 64 == 63) ? '\r' : 'a' + i % 26;
+        }
+        memcpy(paste + len, "\033[201~", 6);
+        len += 6;
+        link_send(in, paste, len, t);
+        free(paste);
+        pending[npending++] = t;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char*    name      = NULL;
+    struct winsize ws        = { 24, 80, 0, 0 };
+    size_t         window    = 65536;
+    int            nkeys     = 0;
+    int            pastesize = 0;
+    int            rounds    = 1;
+    double         timeout   = 60;
+    int            opt;
+
+    while ((opt = getopt(argc, argv, "+n:s:b:l:w:k:p:r:t:H")) != -1) {
+        switch (opt) {
+            case 'n': name      = optarg;                  break;
+            case 'b': bandwidth = atof(optarg);            break;
+            case 'l': latency   = atof(optarg) / 1000;     break;
+            case 'w': window    = strtoul(optarg, NULL, 10); break;
+            case 'k': nkeys     = atoi(optarg);            break;
+            case 'p': pastesize = atoi(optarg);            break;
+            case 'r': rounds    = atoi(optarg);            break;
+            case 't': timeout   = atof(optarg);            break;
+            case 'H': printHeader();                       return 0;
+            case 's': {
+                unsigned cols, rows;
+                if (sscanf(optarg, "%ux%u", &cols, &rows) != 2) {
+                    usage();
+                }
+                ws.ws_col = cols;
+                ws.ws_row = rows;
+                break;
+            }
+            default:  usage();
+        }
+    }
+    if (optind >= argc || window == 0 || (nkeys > 0 && pastesize > 0)) {
+        usage();
+    }
+    if (!name) {
+        name = argv[optind];
+    }
+    bool interactive = (nkeys > 0 || pastesize > 0);
+    if (interactive) {
+        size_t n = (size_t)((nkeys > 0) ? nkeys : 1) * rounds;
+        pending = (double*) malloc((n + 1) * sizeof(double));
+        if (!pending) {
+            die("malloc");
+        }
+    }
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+        die("posix_openpt");
+    }
+    const char* slavename = ptsname(master);
+    if (!slavename) {
+        die("ptsname");
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        die("fork");
+    }
+    if (pid == 0) {
+        setsid();
+        int slave = open(slavename, O_RDWR);
+        if (slave < 0) {
+            die(slavename);
+        }
+    #ifdef TIOCSCTTY
+        ioctl(slave, TIOCSCTTY, 0);
+    #endif
+        ioctl(slave, TIOCSWINSZ, &ws);
+        dup2(slave, 0);
+        dup2(slave, 1);
+        dup2(slave, 2);
+        if (slave > 2) {
+            close(slave);
+        }
+        close(master);
+        execvp(argv[optind], argv + optind);
+        perror(argv[optind]);
+        _exit(127);
+    }
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    Link   out      = { NULL, NULL, 0, 0 };
+    Link   in       = { NULL, NULL, 0, 0 };
+    bool   eof      = false;
+    bool   quitsent = false;
+    int    round    = 0;
+    double deadline = now() + timeout;
+    char   buf[READ_SIZE];
+
+    while (!eof || out.first || in.first) {
+        double t = now();
+        if (t > deadline) {
+            fprintf(stderr, "ptybench: %s: timeout\n", name);
+            kill(pid, SIGKILL);
+            break;
+        }
+        /* deliver output that has arrived */
+        Chunk* c;
+        while ((c = link_peek(&out, t)) != NULL) {
+            parseOutput(c->data, c->len, t);
+            link_pop(&out);
+        }
+        /* send the next input when the previous one was echoed */
+        if (interactive && ready && !eof && headpending == npending) {
+            if (round < rounds) {
+                sendInput(&in, nkeys, pastesize, t);
+                round += 1;
+            } else if (!quitsent) {
+                link_send(&in, "\004", 1, t);
+                quitsent = true;
+            }
+        }
+        /* deliver input that has arrived */
+        bool blocked = false;
+        while (!eof && (c = link_peek(&in, t)) != NULL) {
+            ssize_t n = write(master, c->data + c->pos, c->len - c->pos);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EINTR) {
+                    blocked = true;
+                    break;
+                }
+                eof = true;
+                break;
+            }
+            c->pos += n;
+            if (c->pos < c->len) {
+                blocked = true;
+                break;
+            }
+            link_pop(&in);
+        }
+        if (eof) {
+            while (in.first) {
+                link_pop(&in);
+            }
+        }
+
+        struct pollfd pfd = { master, 0, 0 };
+        if (!eof && out.inflight < window) {
+            pfd.events |= POLLIN;
+        }
+        if (blocked) {
+            pfd.events |= POLLOUT;
+        }
+        if (!pfd.events) {
+            pfd.fd = -1;
+        }
+        double next = t + 0.1;
+        if (out.first && out.first->due < next) {
+            next = out.first->due;
+        }
+        if (!blocked && in.first && in.first->due < next) {
+            next = in.first->due;
+        }
+        int ms = (int)((next - t) * 1000 + 0.999);
+        if (poll(&pfd, 1, (ms > 0) ? ms : 0) < 0 && errno != EINTR) {
+            die("poll");
+        }
+        if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = read(master, buf, sizeof(buf));
+            if (n > 0) {
+                link_send(&out, buf, n, now());
+            } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+                eof = true;  /* EIO: the slave side was closed */
+            }
+        }
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    close(master);
+
+    printReport(name);
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "ptybench: %s: command failed\n", name);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,197 @@
+-- Benchmark workloads, invoked by ptybench on a pseudo-terminal, see README.md in
+-- this directory.
+--
+--     lua workload.lua <name> [frames]
+--
+-- Output workloads write the given number of frames as fast as the terminal
+-- accepts them, input workloads echo each key or paste until Ctrl-D is received.
+
+local dir = arg[0]:match("^(.*)[/\\]") or "."
+local luaVersion = _VERSION:gsub("^Lua ", "")
+package.path  = dir.."/../src/?.lua;"..dir.."/../src/?/init.lua;"..package.path
+package.cpath = dir.."/../src/build/lua"..luaVersion.."/?.so;"..package.cpath
+
+local nocurses = require("nocurses")
+
+local name   = arg[1] or "repaint"
+local frames = tonumber(arg[2]) or 300
+
+local width, height = nocurses.gettermsize()
+
+-- Markers are written with a separate flush if the frame was already flushed,
+-- these system calls are not counted.
+local markerFlushes = 0
+
+local function mark(marker, flush)
+    io.write("\027_ncbench:", marker, "\027\\")
+    if flush then
+        io.flush()
+        markerFlushes = markerFlushes + 1
+    end
+end
+
+-- read and write system calls of this process, nil if not available
+local function syscalls()
+    local f = io.open("/proc/self/io")
+    if not f then
+        return nil
+    end
+    local text = f:read("*a")
+    f:close()
+    local r = tonumber(text:match("syscr:%s*(%d+)"))
+    local w = tonumber(text:match("syscw:%s*(%d+)"))
+    return r and w and r + w
+end
+
+local colors = { "RED", "GREEN", "YELLOW", "BLUE", "MAGENTA", "CYAN", "WHITE" }
+
+-- ============================================================================================
+
+local workloads = {}
+
+-- every cell changes in every frame
+function workloads.repaint()
+    local screen = nocurses.newscreen(width, height)
+    local alphabet = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"
+    for frame = 1, frames do
+        for y = 1, height do
+            local offset = (frame + y) % #alphabet
+            local row = (alphabet:sub(offset + 1)..alphabet:rep(math.floor(width / #alphabet) + 1)):sub(1, width)
+            screen:put(1, y, row, colors[(frame + y) % #colors + 1])
+        end
+        screen:flush()
+        mark("frame", true)
+    end
+    screen:close()
+end
+
+-- log lines are appended at the bottom and the terminal scrolls
+function workloads.scroll()
+    local levels = { "INFO ", "DEBUG", "WARN ", "INFO " }
+    local line = 0
+    for frame = 1, frames do
+        for i = 1, 3 do
+            line = line + 1
+            io.write(string.format("%8.3f %s [worker-%d] processed request %d in %.3f ms\n",
+                                   frame / 60, levels[line % #levels + 1], line % 8,
+                                   line, (line * 7919) % 1000 / 100))
+        end
+        mark("frame")
+        io.flush()
+    end
+end
+
+-- a few cells of a table change in every frame
+function workloads.table()
+    local screen = nocurses.newscreen(width, height)
+    local cols = math.max(1, math.floor((width - 1) / 12))
+    local rows = height - 2
+    for c = 1, cols do
+        screen:put(2 + (c - 1) * 12, 1, string.format("%11s", "column "..c), "DEFAULT", "DEFAULT", "BOLD")
+    end
+    for r = 1, rows do
+        for c = 1, cols do
+            screen:put(2 + (c - 1) * 12, r + 1, string.format("%11.2f", 0))
+        end
+    end
+    screen:flush()
+    local seed = 1
+    local function random(n)
+        seed = (seed * 1103515245 + 12345) % 2147483648
+        return seed % n + 1
+    end
+    for frame = 1, frames do
+        for i = 1, 8 do
+            local c, r = random(cols), random(rows)
+            local value = random(1000000) / 100
+            screen:put(2 + (c - 1) * 12, r + 1, string.format("%11.2f", value),
+                       (value > 5000) and "GREEN" or "RED")
+        end
+        screen:put(1, height, string.format("frame %d", frame), "DEFAULT", "DEFAULT", "INVERT")
+        screen:flush()
+        mark("frame", true)
+    end
+    screen:close()
+end
+
+-- each key is shown in an input line and a status line
+function workloads.keys()
+    local screen = nocurses.newscreen(width, height)
+    local text = ""
+    while true do
+        local key, input = nocurses.getkey()
+        if input == "\004" then
+            break
+        end
+        if key then
+            text = text.."<"..key..">"
+        elseif input then
+            text = text..input
+        end
+        if #text > width then
+            text = text:sub(-width)
+        end
+        screen:put(1, 1, text..string.rep(" ", width - #text))
+        screen:put(1, height, string.format("%-20s", tostring(key or input)), "DEFAULT", "DEFAULT", "INVERT")
+        screen:flush()
+        mark("frame")
+        mark("echo", true)
+    end
+    screen:close()
+end
+
+-- the beginning of each pasted line is shown
+function workloads.paste()
+    local screen = nocurses.newscreen(width, height)
+    nocurses.setpaste(true)
+    while true do
+        local key, input = nocurses.getkey()
+        if input == "\004" then
+            break
+        end
+        if key == "Paste" then
+            local y = 1
+            for line in input:gmatch("[^\r\n]+") do
+                if y >= height then
+                    break
+                end
+                screen:put(1, y, line:sub(1, width)..string.rep(" ", width - #line))
+                y = y + 1
+            end
+            screen:put(1, height, string.format("pasted %d bytes", #input), "DEFAULT", "DEFAULT", "INVERT")
+            screen:flush()
+            mark("frame")
+            mark("echo", true)
+        end
+    end
+    nocurses.setpaste(false)
+    screen:close()
+end
+
+-- ============================================================================================
+
+local workload = workloads[name]
+if not workload then
+    io.stderr:write("unknown workload: ", name, "\n")
+    os.exit(2)
+end
+
+io.stdout:setvbuf("full", 65536)
+nocurses.setraw(true)
+nocurses.hidecursor()
+nocurses.clrscr()
+
+local before = syscalls()
+mark("ready", true)
+
+workload()
+
+local after = syscalls()
+nocurses.resetcolors()
+nocurses.showcursor()
+nocurses.setraw(false)
+if before and after then
+    mark("syscalls:"..(after - before - markerFlushes))
+end
+io.write("\n")
+io.flush()
@@ -32,16 +32,14 @@ while true do
         redisplay = false
     end
 
-    local c = nocurses.getch() -- might be nil if terminal size changes
-    c = c and string.char(c)
+    local event, a1, a2 = nocurses.nextevent()
 
-    local w, h = nocurses.gettermsize()
-    if w ~= width or h ~= height then
-        width, height = w, h
+    if event == "resize" then
+        width, height = a1, a2
         redisplay = true
-    end
-
-    if c == "Q" or c == "q" then
+    elseif event == "signal" and a1 == "CONT" then
+        redisplay = true
+    elseif event == "text" and (a1 == "Q" or a1 == "q") then
         break
     end
 end
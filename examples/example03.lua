@@ -73,10 +73,9 @@ nocurses.setfontbold(false)
 
 local started = true
 while true do
-    local c = nocurses.getch()
-    c = c and string.char(c)
-    local status = threadOut:nextmsg(0)
-    if status then
+    local event, c = nocurses.nextevent()
+    local status = (event == "notify") and threadOut:nextmsg(0)
+    while status do
         if status:match("^paused") then
             started = false
             nocurses.setfontbold(true)
@@ -90,6 +89,10 @@ while true do
         end
         printf("Thread status: %s\n", status)
         nocurses.resetcolors()
+        status = threadOut:nextmsg(0)
+    end
+    if event ~= "text" then
+        c = nil
     end
     if c == ' ' then
         if started then
@@ -18,6 +18,7 @@ local function printCentered(y, ...)
 end
 
 nocurses.hidecursor()
+nocurses.setcoalesce(true) -- hold down arrow key: redisplay once for all repetitions
 
 while true do
     if redisplay then
@@ -31,7 +32,8 @@ while true do
         redisplay = false
     end
 
-    local key, input = nocurses.getkey() -- might be nil if terminal size changes
+    local key, input, event, count = nocurses.getkey() -- might be nil if terminal size changes
+    count = count or 1
     
     if not key then
         key = string.upper(input)
@@ -47,16 +49,16 @@ while true do
             break                                                                                         
     
         elseif key == "Up" then
-            value = value + 10
+            value = value + 10 * count
       
         elseif key == "Down" then
-            value = value - 10
+            value = value - 10 * count
       
         elseif key == "Right" then
-            value = value + 1
+            value = value + count
       
         elseif key == "Left" then
-            value = value - 1
+            value = value - count
         else
             print(inp)
         end
@@ -107,6 +107,19 @@ static inline int atomic_set(AtomicCounter* value, int newValue)
 
 /* -------------------------------------------------------------------------------------------- */
 
+static inline void atomic_fence()
+{
+#if defined(NOCURSES_ASYNC_USE_WIN32)
+    MemoryBarrier();
+#elif defined(NOCURSES_ASYNC_USE_STDATOMIC)
+    atomic_thread_fence(memory_order_seq_cst);
+#elif defined(NOCURSES_ASYNC_USE_GNU)
+    __sync_synchronize();
+#endif
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
 
 #endif /* NOCURSES_ASYNC_UTIL_H */
 
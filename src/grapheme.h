@@ -0,0 +1,38 @@
+#ifndef NOCURSES_GRAPHEME_H
+#define NOCURSES_GRAPHEME_H
+
+#include "util.h"
+
+#include <stdint.h>
+
+/* -------------------------------------------------------------------------------------------- */
+
+/*
+ * UTF-8 decoding and grapheme cluster segmentation for terminal input. The
+ * segmentation follows the rules of Unicode Standard Annex #29 that matter for
+ * typed or pasted text: combining marks and spacing marks, zero width joiner 
+ * sequences of emoji, emoji modifiers, regional indicator pairs (flags) and 
+ * Hangul syllable sequences.
+ */
+
+/* -------------------------------------------------------------------------------------------- */
+
+#define utf8_decode      nocurses_utf8_decode
+#define grapheme_length  nocurses_grapheme_length
+
+/**
+ * Decodes the code point at p. Returns the number of bytes, 0 if the sequence
+ * is incomplete within len bytes and -1 if it is invalid.
+ */
+int utf8_decode(const unsigned char* p, size_t len, uint32_t* cp);
+
+/**
+ * Returns the number of bytes of the grapheme cluster at p that are contained 
+ * within len bytes. Invalid bytes form a cluster of their own, an incomplete 
+ * code point at the end is not included.
+ */
+size_t grapheme_length(const unsigned char* p, size_t len);
+
+/* -------------------------------------------------------------------------------------------- */
+
+#endif /* NOCURSES_GRAPHEME_H */
@@ -0,0 +1,330 @@
+#include "key_decoder.h"
+#include "grapheme.h"
+
+/* -------------------------------------------------------------------------------------------- */
+
+typedef struct {
+    int         code;
+    const char* name;
+} KeyName;
+
+/* key codes of CSI ... u sequences that are not printable characters */
+static const KeyName codeNames[] =
+{
+    {     9, "Tab"          },
+    {    13, "Enter"        },
+    {    27, "Escape"       },
+    {    32, "Space"        },
+    {   127, "Backspace"    },
+    { 57358, "CapsLock"     },
+    { 57359, "ScrollLock"   },
+    { 57360, "NumLock"      },
+    { 57361, "PrintScreen"  },
+    { 57362, "Pause"        },
+    { 57363, "Menu"         },
+    { 57399, "KP0"          },
+    { 57400, "KP1"          },
+    { 57401, "KP2"          },
+    { 57402, "KP3"          },
+    { 57403, "KP4"          },
+    { 57404, "KP5"          },
+    { 57405, "KP6"          },
+    { 57406, "KP7"          },
+    { 57407, "KP8"          },
+    { 57408, "KP9"          },
+    { 57409, "KPDecimal"    },
+    { 57410, "KPDivide"     },
+    { 57411, "KPMultiply"   },
+    { 57412, "KPSubtract"   },
+    { 57413, "KPAdd"        },
+    { 57414, "KPEnter"      },
+    { 57415, "KPEqual"      },
+    { 57417, "KPLeft"       },
+    { 57418, "KPRight"      },
+    { 57419, "KPUp"         },
+    { 57420, "KPDown"       },
+    { 57421, "KPPageUp"     },
+    { 57422, "KPPageDown"   },
+    { 57423, "KPHome"       },
+    { 57424, "KPEnd"        },
+    { 57425, "KPInsert"     },
+    { 57426, "KPDelete"     },
+    { 57427, "KPBegin"      },
+    { 57441, "LeftShift"    },
+    { 57442, "LeftCtrl"     },
+    { 57443, "LeftAlt"      },
+    { 57444, "LeftSuper"    },
+    { 57445, "LeftHyper"    },
+    { 57446, "LeftMeta"     },
+    { 57447, "RightShift"   },
+    { 57448, "RightCtrl"    },
+    { 57449, "RightAlt"     },
+    { 57450, "RightSuper"   },
+    { 57451, "RightHyper"   },
+    { 57452, "RightMeta"    },
+    {     0, NULL           }
+};
+
+/* key numbers of CSI number ... ~ sequences */
+static const KeyName tildeNames[] =
+{
+    {  2, "Insert"   },
+    {  3, "Delete"   },
+    {  5, "PageUp"   },
+    {  6, "PageDown" },
+    {  7, "Home"     },
+    {  8, "End"      },
+    { 11, "F1"       },
+    { 12, "F2"       },
+    { 13, "F3"       },
+    { 14, "F4"       },
+    { 15, "F5"       },
+    { 17, "F6"       },
+    { 18, "F7"       },
+    { 19, "F8"       },
+    { 20, "F9"       },
+    { 21, "F10"      },
+    { 23, "F11"      },
+    { 24, "F12"      },
+    {  0, NULL       }
+};
+
+/* final bytes of CSI 1 ; modifiers X sequences, 'R' is omitted because of the 
+ * ambiguity with cursor position reports */
+static const KeyName letterNames[] =
+{
+    { 'A', "Up"      },
+    { 'B', "Down"    },
+    { 'C', "Right"   },
+    { 'D', "Left"    },
+    { 'E', "KPBegin" },
+    { 'F', "End"     },
+    { 'H', "Home"    },
+    { 'P', "F1"      },
+    { 'Q', "F2"      },
+    { 'S', "F4"      },
+    {  0,  NULL      }
+};
+
+static const char* lookup(const KeyName* table, int code)
+{
+    for (; table->name; ++table) {
+        if (table->code == code) {
+            return table->name;
+        }
+    }
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+static int encodeUtf8(unsigned int cp, char* out)
+{
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    } else if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    } else if (cp < 0x10000) {
+        if (cp >= 0xD800 && cp <= 0xDFFF) {
+            return 0;
+        }
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    } else if (cp < 0x110000) {
+        out[0] = (char)(0xF0 | (cp >> 18));
+        out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[3] = (char)(0x80 | (cp & 0x3F));
+        return 4;
+    }
+    return 0;
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+#define MAX_PARAMS     3
+#define MAX_SUBPARAMS  3
+
+bool key_decode_csi(const char* seq, size_t len, KeyEvent* ev)
+{
+    if (len < 3 || seq[0] != 0x1B || seq[1] != '[') {
+        return false;
+    }
+    /* params[i][j]: j-th sub parameter of i-th parameter, -1 if empty */
+    long params[MAX_PARAMS][MAX_SUBPARAMS];
+    for (int i = 0; i < MAX_PARAMS; ++i) {
+        for (int j = 0; j < MAX_SUBPARAMS; ++j) {
+            params[i][j] = -1;
+        }
+    }
+    int    np    = 0;
+    int    nsp   = 0;
+    char   final = seq[len - 1];
+    for (size_t k = 2; k < len - 1; ++k) {
+        char c = seq[k];
+        if (c >= '0' && c <= '9') {
+            if (np < MAX_PARAMS && nsp < MAX_SUBPARAMS) {
+                long v = params[np][nsp];
+                v = (v < 0 ? 0 : v) * 10 + (c - '0');
+                if (v > 0x10FFFF) {
+                    return false;
+                }
+                params[np][nsp] = v;
+            }
+        } 
+        else if (c == ';') {
+            ++np;
+            nsp = 0;
+        }
+        else if (c == ':') {
+            ++nsp;
+        }
+        else {
+            return false; /* private or intermediate bytes, e.g. ESC [ < or ESC [ ? */
+        }
+    }
+    long code     = params[0][0];
+    long modvalue = params[1][0];
+    long event    = params[1][1];
+
+    ev->mods   = (modvalue > 0) ? (int)((modvalue - 1) & 0x3F) : 0;
+    ev->event  = (event >= KEY_EVENT_PRESS && event <= KEY_EVENT_RELEASE) ? (int)event 
+                                                                            : KEY_EVENT_PRESS;
+    ev->isText = false;
+
+    const char* name = NULL;
+    if (final == 'u') {
+        if (code < 0) {
+            return false;
+        }
+        name = lookup(codeNames, code);
+        if (!name) {
+            if (code < 32 || (code >= 57344 && code <= 63743)) {
+                return false; /* unknown control or functional key */
+            }
+            if (params[2][0] > 0) {
+                code = params[2][0];  /* associated text */
+            }
+            else if ((ev->mods & KEY_MOD_SHIFT) && params[0][1] > 0) {
+                code = params[0][1];  /* shifted key */
+            }
+            int n = encodeUtf8((unsigned int)code, ev->key);
+            if (n == 0) {
+                return false;
+            }
+            ev->key[n] = '\0';
+            ev->isText = true;
+            if (ev->mods & KEY_MOD_CTRL) {
+                /* same naming as for legacy control characters, e.g. "Ctrl+A" */
+                if (ev->key[0] >= 'a' && ev->key[0] <= 'z' && n == 1) {
+                    ev->key[0] = ev->key[0] - 'a' + 'A';
+                }
+            }
+        }
+    }
+    else if (final == '~') {
+        name = lookup(tildeNames, code);
+    }
+    else if (code <= 1) {
+        name = lookup(letterNames, final);
+    }
+    if (name) {
+        strcpy(ev->key, name);
+    }
+    else if (!ev->isText) {
+        return false;
+    }
+    char* p = ev->name;
+    if (ev->mods & KEY_MOD_CTRL)  { strcpy(p, "Ctrl+");  p += 5; }
+    if (ev->mods & KEY_MOD_ALT)   { strcpy(p, "Alt+");   p += 4; }
+    if (ev->mods & KEY_MOD_SHIFT) { strcpy(p, "Shift+"); p += 6; }
+    if (ev->mods & KEY_MOD_SUPER) { strcpy(p, "Super+"); p += 6; }
+    if (ev->mods & KEY_MOD_HYPER) { strcpy(p, "Hyper+"); p += 6; }
+    if (ev->mods & KEY_MOD_META)  { strcpy(p, "Meta+");  p += 5; }
+    strcpy(p, ev->key);
+    return true;
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+const char* key_event_name(int event)
+{
+    switch (event) {
+        case KEY_EVENT_REPEAT:  return "repeat";
+        case KEY_EVENT_RELEASE: return "release";
+        default:                return "press";
+    }
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+/* number of bytes of the UTF-8 character with the given lead byte */
+static int utf8Length(int c)
+{
+    if      (c >= 0xF0 && c <= 0xF7) return 4;
+    else if (c >= 0xE0)              return 3;
+    else if (c >= 0xC0)              return 2;
+    else                             return 1;
+}
+
+/* length of the UTF-8 character at offs, 0 if incomplete */
+static int utf8Sequence(const unsigned char* p, size_t len, size_t offs, bool final)
+{
+    int n = utf8Length(p[offs]);
+    for (int i = 1; i < n; ++i) {
+        if (offs + i >= len) {
+            return final ? i : 0;
+        }
+        if (p[offs + i] < 0x80 || p[offs + i] > 0xBF) {
+            return i;
+        }
+    }
+    return n;
+}
+
+int key_sequence_length(const unsigned char* p, size_t len, bool final)
+{
+    if (p[0] != 0x1B) {
+        int n = utf8Sequence(p, len, 0, final);
+        if (n == 0) {
+            return 0;
+        }
+        /* combining characters etc. are sent together, no waiting for further bytes */
+        size_t g = grapheme_length(p, len);
+        return ((size_t)n < g) ? (int)g : n;
+    }
+    if (len < 2) {
+        return final ? 1 : 0;
+    }
+    int c1 = p[1];
+    if (c1 == '[') {
+        for (size_t i = 2; ; ++i) {
+            if (i >= len) {
+                return final ? (int)i : 0;
+            }
+            if (p[i] == 0x1B) {
+                return i;
+            }
+            if (p[i] >= 0x40 || p[i] < 0x20) {
+                return i + 1;  /* final byte */
+            }
+        }
+    }
+    else if (c1 == 'O') {
+        return (len < 3) ? (final ? 2 : 0) : 3;
+    }
+    else if (c1 == 0x1B) {
+        return 1;  /* ESC ESC: Escape key followed by another key */
+    }
+    else {
+        int n = utf8Sequence(p, len, 1, final);
+        return (n == 0) ? 0 : 1 + n;
+    }
+}
+
+/* -------------------------------------------------------------------------------------------- */
@@ -0,0 +1,62 @@
+#ifndef NOCURSES_KEY_DECODER_H
+#define NOCURSES_KEY_DECODER_H
+
+#include "util.h"
+
+/* -------------------------------------------------------------------------------------------- */
+
+/*
+ * Decoder for CSI key sequences of the progressive keyboard enhancement 
+ * protocol (CSI code[:alternates] ; modifiers[:event] [; text] u) and for the
+ * xterm style key sequences with modifiers (CSI 1 ; modifiers[:event] A,
+ * CSI number ; modifiers[:event] ~).
+ */
+
+#define KEY_MOD_SHIFT   0x01
+#define KEY_MOD_ALT     0x02
+#define KEY_MOD_CTRL    0x04
+#define KEY_MOD_SUPER   0x08
+#define KEY_MOD_HYPER   0x10
+#define KEY_MOD_META    0x20
+
+#define KEY_EVENT_PRESS    1
+#define KEY_EVENT_REPEAT   2
+#define KEY_EVENT_RELEASE  3
+
+#define KEY_NAME_MAXLEN    64
+
+typedef struct {
+    char key[16];             /* key name without modifiers or UTF-8 character */
+    bool isText;              /* key is a printable character */
+    int  mods;                /* KEY_MOD_* bits */
+    int  event;               /* KEY_EVENT_* */
+    char name[KEY_NAME_MAXLEN]; /* key name with modifier prefix, e.g. "Ctrl+Alt+Up" */
+} KeyEvent;
+
+#define key_decode_csi       nocurses_key_decode_csi
+#define key_event_name       nocurses_key_event_name
+#define key_sequence_length  nocurses_key_sequence_length
+
+/**
+ * Decodes the complete CSI sequence seq of length len (including the leading
+ * ESC [). Returns false if seq is not a known key sequence.
+ */
+bool key_decode_csi(const char* seq, size_t len, KeyEvent* ev);
+
+/**
+ * Returns the event type as string: "press", "repeat" or "release".
+ */
+const char* key_event_name(int event);
+
+/**
+ * Determines the length of the key sequence at p: an escape sequence (CSI, SS3, 
+ * ESC followed by a character) or a grapheme cluster. len must be at least 1.
+ * Returns 0 if further bytes are needed to complete the sequence. If final is true,
+ * no further bytes are expected and the length of the incomplete sequence is 
+ * returned instead.
+ */
+int key_sequence_length(const unsigned char* p, size_t len, bool final);
+
+/* -------------------------------------------------------------------------------------------- */
+
+#endif /* NOCURSES_KEY_DECODER_H */
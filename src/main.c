@@ -5,14 +5,29 @@
 # include <sys/time.h>
 # include <fcntl.h>
 # include <signal.h>
+# include <time.h>
+# include <pthread.h>
+#endif
+#include <stdarg.h>
+#if defined(__linux__)
+# include <sys/eventfd.h>
 #endif
 
 #include "main.h"
+#include "timer_wheel.h"
+#include "key_decoder.h"
+#include "spsc_ring.h"
 
 /* ============================================================================================ */
 
 #define NOTIFY_CAPI_IMPLEMENT_SET_CAPI 1
 #include "notify_capi.h"
+#include "screen_buffer.h"
+#include "terminal.h"
+#include "term_mux.h"
+#include "render_pool.h"
+#include "vterm.h"
+#include "trace_ring.h"
 
 /* ============================================================================================ */
 
@@ -38,737 +53,4698 @@ static void*         udata = NULL;
 #if defined(__unix__)    
 
 static int            nc_awake_fds[2];
-static unsigned char  nc_readbuffer[NC_READBUFLEN];
+static unsigned char  nc_readbuffer0[NC_READBUFLEN];
+static unsigned char* nc_readbuffer = nc_readbuffer0;
+static size_t         nc_readcap    = NC_READBUFLEN;
 static size_t         nc_readlen = 0;
 static size_t         nc_readpos = 0;
 static bool           nc_hidecur = 0;
+static int            nc_mousemode = 0;
+static bool           nc_pastemode = false;
+static int            nc_kbdflags  = 0;
+static bool           nc_coalesce  = false;
 
-#endif /* __unix__ */
+#define NC_WATCH_READ   1
+#define NC_WATCH_WRITE  2
+#define NC_WATCH_CLOSED 4  /* reported for a fd that was closed while watched */
+
+typedef struct {
+    int fd;
+    int events;
+} WatchEntry;
+
+static WatchEntry*    nc_watches      = NULL;
+static int            nc_watchcnt     = 0;
+static int            nc_watchcap     = 0;
+static int            nc_watchnext    = 0;
+static int            nc_readyfd      = -1;
+static int            nc_readyevents  = 0;
+
+typedef struct {
+    Terminal     term;   /* first member, TermObject* may be used as Terminal* */
+    TermMuxEntry mux;
+    int          id;     /* target id for screen buffers, see checkTarget() */
+} TermObject;
+
+static int            nc_termids      = 0;
+
+/* attached terminal objects, the registry table at &nc_termmux maps entries to objects */
+static TermMux        nc_termmux      = { -1, NULL, 0, 0, NULL, NULL };
+
+/*
+ * Asynchronous renders of screen buffers into terminal objects. The diff against
+ * the last shown content and the encoding are done by the render pool, the main
+ * thread appends the finished output to the target terminal. There is at most 
+ * one render per screen, renders requested meanwhile are coalesced into one 
+ * render that follows.
+ */
+typedef struct ScreenRender ScreenRender;
+
+struct ScreenRender {
+    RenderJob     job;          /* first member */
+    ScreenBuffer* sb;           /* retained while pending */
+    int           ox;
+    int           oy;
+    int           cnt;          /* changed cells, set by the worker */
+    TermObject*   term;         /* target, NULL if closed, main thread only */
+    bool          again;        /* render again after this render has finished */
+    TermObject*   againterm;
+    int           againx;
+    int           againy;
+    int           id;           /* screen id for the report */
+    ScreenRender* pendingnext;  /* list of submitted renders */
+    ScreenRender* reportnext;   /* list of finished renders to report */
+};
+
+static int            nc_renderthreads = -1;    /* -1 if the render pool is not started */
+static ScreenRender*  nc_renderfirst   = NULL;  /* submitted renders */
+static ScreenRender*  nc_rreportfirst  = NULL;  /* finished renders, oldest first */
+static ScreenRender*  nc_rreportlast   = NULL;
+
+typedef struct NcTimer NcTimer;
+
+struct NcTimer {
+    TimerNode   node;
+    lua_Integer id;
+    int         index;       /* in nc_timertab */
+    uint64_t    interval;    /* in ticks, 0 for one-shot timers */
+    bool        pending;     /* in expired queue */
+    bool        canceled;
+    NcTimer*    nextPending;
+};
+
+static TimerWheel     nc_timerwheel;
+static NcTimer**      nc_timertab     = NULL;  /* active timers, free slots are NULL */
+static int            nc_timertabcap  = 0;
+static lua_Integer    nc_timerid      = 0;     /* last assigned timer id */
+static NcTimer*       nc_pendingfirst = NULL;
+static NcTimer*       nc_pendinglast  = NULL;
+
+#define NC_INPUTSTAMPS 32
+
+typedef struct {
+    uint64_t end;   /* input stream position after the read */
+    double   time;  /* monotonic time of the read */
+} InputStamp;
+
+static InputStamp     nc_stamps[NC_INPUTSTAMPS];
+static int            nc_stampfirst   = 0;
+static int            nc_stampcnt     = 0;
+static uint64_t       nc_streamend    = 0;     /* number of bytes read from stdin */
+static double         nc_inputtime    = -1;    /* time of last obtained input */
+
+#define NC_READERRING  (64 * 1024)
+#define NC_READERCHUNK 4096
 
+/* header of an input chunk in the reader ring */
+typedef struct {
+    int    len;     /* 0 for end of input */
+    double time;
+} InputChunk;
+
+static SpscRing       nc_readerring;
+static pthread_t      nc_readerthread;
+static bool           nc_readeron      = false;
+static int            nc_readerstop[2] = { -1, -1 };  /* pipe for stopping the reader thread */
+static AtomicCounter  nc_readerwake    = 0;      /* reader thread has delivered input */
+static int            nc_chunkleft     = 0;      /* unread bytes of current chunk */
+static double         nc_chunktime     = 0;
+static bool           nc_readereof     = false;
+
+/* recording file: magic, then per chunk delay in microseconds, length, bytes */
+#define NC_RECORD_MAGIC "NCREC1\n"
+
+static FILE*          nc_recordfile    = NULL;
+static double         nc_recordlast    = 0;      /* time of last recorded chunk */
+static FILE*          nc_replayfile    = NULL;
+static bool           nc_replaymax     = false;  /* replay at maximum speed */
+static double         nc_replaydue     = 0;      /* time when current chunk is delivered */
+static int            nc_replayleft    = 0;      /* bytes of current chunk not yet delivered */
+static bool           nc_replayend     = false;  /* end of replay not yet reported */
+
+static void doneSignals();
+static void stopReader();
+static void stopRecord();
+static void stopReplay();
+static void freeRenders();
+static void releaseTimer(NcTimer* t);
+static NcTimer* popExpiredTimer();
+static double getTime();
+
+#define NC_YIELDABLE (LUA_VERSION_NUM >= 502)
+
+#if NC_YIELDABLE
+static bool           nc_yieldmode    = false;  /* getch/getseq suspend coroutines */
+#endif
 
+#endif /* __unix__ */
 
 /* ============================================================================================ */
 
-static int handleClosingLuaState(lua_State* L)
+/*
+ * Optional trace of the output and input bytes, see nocurses.trace(). Records are
+ * tagged with the name of the running module function, which is set by TRACE_CALL().
+ */
+static TraceRing   nc_trace;              /* cap is 0 while tracing is disabled */
+static const char* nc_tracetag  = NULL;
+static char*       nc_tracefile = NULL;   /* the trace is written into when closing */
+
+#define TRACE_CALL() (nc_tracetag = __func__)
+
+static double traceTime()
 {
-    bool restricted = true;
-    if (lua_rawgetp(L, LUA_REGISTRYINDEX, NOCURSES_MODULE_NAME) == LUA_TUSERDATA) {
-        if (lua_touserdata(L, -1) == udata) {
-            restricted = false;
-        }
-    }
-    lua_pop(L, 1);
-    if (!restricted) {
-        if (atomic_set_if_equal(&initStage, 1, 0)) {
-            if (nc_hidecur) {
-                nc_hidecur = false;
-                showcursor();
-            }
-            if (isRaw) {
-                setRaw(false);
-            }
-            fflush(stdout);
-        }
+#if defined(__unix__)
+    return getTime();
+#else
+    return (double)GetTickCount64() / 1000;
+#endif
+}
+
+static void traceOutput(const char* data, size_t len)
+{
+    if (nc_trace.cap > 0) {
+        trace_ring_record(&nc_trace, traceTime(), TRACE_OUTPUT, nc_tracetag, data, len);
     }
-    return 0;
 }
 
-/* ============================================================================================ */
+static void writeTraceToFile(void* ctx, const char* data, size_t len)
+{
+    fwrite(data, 1, len, (FILE*)ctx);
+}
 
-#if defined(__unix__)
+static void writeTraceToBuffer(void* ctx, const char* data, size_t len)
+{
+    luaL_addlstring((luaL_Buffer*)ctx, data, len);
+}
 
-static void sendAwake()
+/* writes the trace into the named file, returns false and sets errno on failure */
+static bool dumpTraceFile(const char* name)
 {
-    if (nc_awake_fds[0] >= 0) {
-      char c = 0;
-      if (write(nc_awake_fds[1], &c, 1) != 1) {
-        // ignore
-      }
+    FILE* f = fopen(name, "w");
+    if (!f) {
+        return false;
     }
+    trace_ring_dump(&nc_trace, writeTraceToFile, f);
+    return fclose(f) == 0;
 }
 
-static void handleSwinch(int sig)
+/* ============================================================================================ */
+
+#define SEQ_DEF(n,v)  SEQ_IDX_##n,
+enum { SEQUENCE_DEFINES SEQ_COUNT };
+#undef SEQ_DEF
+
+#define SEQ_DEF(n,v)  #n,
+static const char* const seqNames[] = { SEQUENCE_DEFINES NULL };
+#undef SEQ_DEF
+
+/* statistics counters, updated by the main thread only, see nocurses.stats() */
+typedef struct NcStats {
+    uint64_t seqcount[SEQ_COUNT];  /* sequences written to stdout per type */
+    uint64_t seqbytes[SEQ_COUNT];
+    uint64_t outbytes;             /* all bytes written to stdout by the module */
+    uint64_t flushes;
+    uint64_t writes;               /* flushes with pending output of the module */
+    uint64_t reads;                /* read() calls on stdin */
+    uint64_t readbytes;
+    uint64_t waits;                /* select() calls of the main thread */
+    uint64_t wakeinput;
+    uint64_t wakeawake;
+    uint64_t wakesignal;
+    uint64_t waketimeout;
+    uint64_t wakeother;
+    uint64_t termios;              /* changes of the terminal settings */
+    uint64_t memmoves;             /* input queue compactions */
+    uint64_t memmovebytes;
+} NcStats;
+
+static NcStats nc_stats;
+static size_t  nc_outpending = 0;  /* bytes written to stdout since the last flush */
+
+static void countSeq(int idx, size_t n)
 {
-    sendAwake();
+    nc_stats.seqcount[idx] += 1;
+    nc_stats.seqbytes[idx] += n;
+    nc_stats.outbytes      += n;
+    nc_outpending          += n;
 }
 
-static void initAwake()
+static void putSeq(int idx, const char* seq, size_t len)
 {
-    if (pipe(nc_awake_fds) == 0) {
-        fcntl(nc_awake_fds[1],
-              F_SETFL,
-              fcntl(nc_awake_fds[1], F_GETFL) | O_NONBLOCK);
-        signal(SIGWINCH, handleSwinch);  /* set C-signal handler */
-    } else {
-        nc_awake_fds[0] = -1;
-    }
+    fwrite(seq, 1, len, stdout);
+    countSeq(idx, len);
+    traceOutput(seq, len);
 }
 
-static bool drainAwakePipe()
+static void printSeq(int idx, const char* fmt, ...)
 {
-    bool hasAwake = false;
-    const int afd  = nc_awake_fds[0];
-    if (afd >= 0) {
-        fd_set fds;
-        int    nfds = afd + 1;
-        FD_ZERO(&fds);
-        FD_SET(afd, &fds);
-        struct timeval tv  = {0, 0};
-        int            ret = select(nfds, &fds, NULL, NULL, &tv);
-        if (ret > 0 && FD_ISSET(afd, &fds)) {
-            hasAwake = true;
-            char buf[128];
-            if (read(afd, buf, sizeof(buf)) < 0) {
-                // ignore
-            }
+    char    buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n >= (int)sizeof(buf)) {
+        /* e.g. a long title, formatted again so that the traced bytes are complete */
+        char* big = (char*) malloc(n + 1);
+        if (big) {
+            va_start(args, fmt);
+            vsnprintf(big, n + 1, fmt, args);
+            va_end(args);
+            putSeq(idx, big, n);
+            free(big);
+        } else {
+            putSeq(idx, buf, sizeof(buf) - 1);
         }
+    } else if (n > 0) {
+        putSeq(idx, buf, n);
     }
-    return hasAwake;
 }
 
-static bool hasInputAt(int i)
+/* flushes stdout, a flush with pending output of the module counts as write */
+static void flushOutput()
 {
-    return (nc_readpos + i < nc_readlen);
+    nc_stats.flushes += 1;
+    if (nc_outpending > 0) {
+        nc_stats.writes += 1;
+        nc_outpending    = 0;
+    }
+    fflush(stdout);
 }
 
-static void clearInput()
+/* 
+ * Writes a sequence to stdout, counts and traces it. Module functions use these 
+ * instead of the output primitives of nocurses.h.
+ */
+#define PUTSEQ(n)        putSeq(SEQ_IDX_##n, SEQ(n), sizeof(SEQ(n)) - 1)
+#define PRINTSEQ(n, ...) printSeq(SEQ_IDX_##n, SEQ(n), __VA_ARGS__)
+
+/* restores the attributes that were set by the nocurses module functions */
+static void restoreAttrs()
 {
-    nc_readpos = 0;
-    nc_readlen = 0;
+    PUTSEQ(reset_attrs);
+    if (font_color >= 0) PRINTSEQ(set_foregrd_color, font_color);
+    if (bg_color   >= 0) PRINTSEQ(set_backgrd_color, bg_color);
+    if (font_bold)       PUTSEQ(set_attr_bold);
+    if (font_underline)  PUTSEQ(set_attr_underline);
+    if (font_blink)      PUTSEQ(set_attr_blink);
+    if (font_invert)     PUTSEQ(set_attr_inverse);
 }
 
-static bool hasInput()
+/* sets one of the attribute flags of nocurses.h like setfontbold() etc. */
+static void setAttr(int* attr, int status, int idx, const char* seq, size_t len)
 {
-    return (nc_readpos < nc_readlen);
+    *attr = status;
+    if (status) {
+        putSeq(idx, seq, len);
+    } else {
+        restoreAttrs();
+    }
 }
 
-static bool waitForInput(const double timeout)
+#define SETATTR(attr, status, n) setAttr(&attr, status, SEQ_IDX_##n, SEQ(n), sizeof(SEQ(n)) - 1)
+
+/* like setRaw(), counts the changes of the terminal settings */
+static void switchRaw(bool raw)
 {
-    if (drainAwakePipe()) {
-        return false;
+    if (isRaw != raw) {
+        setRaw(raw);
+        nc_stats.termios += 1;
     }
+}
 
-    const int ifd  = STDIN_FILENO;
-    const int afd  = nc_awake_fds[0];
-    int       nfds = (ifd > afd ? ifd : afd) + 1;
+/* ============================================================================================ */
 
-    struct termios oldattr, newattr;
-    tcgetattr(STDIN_FILENO, &oldattr);
+#if defined(__unix__)
 
-    newattr = oldattr;
-    newattr.c_lflag &= ~(ICANON | ECHO);
-    tcsetattr(STDIN_FILENO, TCSANOW, &newattr);
+enum {
+    MOUSE_OFF    = 0,
+    MOUSE_CLICK  = 1,
+    MOUSE_DRAG   = 2,
+    MOUSE_MOTION = 3
+};
 
-    int       ret  = 0;
-    fd_set    fds;
-    FD_ZERO(&fds);
-    FD_SET(ifd, &fds);
-    if (afd >= 0) {
-        FD_SET(afd, &fds);
+static void setMouseMode(int mode)
+{
+    switch (nc_mousemode) {
+        case MOUSE_CLICK:  PUTSEQ(mouse_click_off);  break;
+        case MOUSE_DRAG:   PUTSEQ(mouse_drag_off);   break;
+        case MOUSE_MOTION: PUTSEQ(mouse_motion_off); break;
     }
-    if (timeout < 0.0) {
-       ret = select(nfds, &fds, NULL, NULL, NULL);
-    } else {
-        const long     sec  = (long)timeout;
-        const long     usec = (long)((timeout - (double)sec) * 1e6);
-        struct timeval tv   = {sec, usec};
-        ret                 = select(nfds, &fds, NULL, NULL, &tv);
+    switch (mode) {
+        case MOUSE_CLICK:  PUTSEQ(mouse_click_on);   break;
+        case MOUSE_DRAG:   PUTSEQ(mouse_drag_on);    break;
+        case MOUSE_MOTION: PUTSEQ(mouse_motion_on);  break;
     }
-    bool hasSignal = (ret == -1) && (errno == EINTR);
-    bool hasInp    = (ret > 0) && (FD_ISSET(ifd, &fds));
-    bool hasAwake  = (ret > 0) && (afd >= 0) && (FD_ISSET(afd, &fds));
-    if (hasAwake || hasSignal) {
-        drainAwakePipe();
+    if (mode && !nc_mousemode) {
+        PUTSEQ(mouse_sgr_on);
     }
-    tcsetattr(STDIN_FILENO, TCSANOW, &oldattr);
-
-    return hasInp;
+    else if (!mode && nc_mousemode) {
+        PUTSEQ(mouse_sgr_off);
+    }
+    nc_mousemode = mode;
 }
 
 #endif /* __unix__ */
 
 /* ============================================================================================ */
 
-static int Nocurses_wait(lua_State* L)
+static int handleClosingLuaState(lua_State* L)
 {
-    clearInput();
-#if defined(__unix__)
-    while (true) {
-        if (waitForInput(-1)) {
-            if (fgetc(stdin) == '\n') {
-                break;
+    bool restricted = true;
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, NOCURSES_MODULE_NAME) == LUA_TUSERDATA) {
+        if (lua_touserdata(L, -1) == udata) {
+            restricted = false;
+        }
+    }
+    lua_pop(L, 1);
+    if (!restricted) {
+        if (atomic_set_if_equal(&initStage, 1, 0)) {
+            TRACE_CALL();
+            if (nc_hidecur) {
+                nc_hidecur = false;
+                PUTSEQ(show_cur);
             }
-        } else {
-            break;
+        #if defined(__unix__)
+            if (nc_mousemode) {
+                setMouseMode(0);
+            }
+            if (nc_pastemode) {
+                nc_pastemode = false;
+                PUTSEQ(paste_off);
+            }
+            if (nc_kbdflags) {
+                nc_kbdflags = 0;
+                PUTSEQ(keyboard_pop);
+            }
+        #endif
+        #if defined(__unix__)
+            stopReader();
+            stopRecord();
+            stopReplay();
+            nc_replayend = false;
+        #endif
+            if (isRaw) {
+                switchRaw(false);
+            }
+            flushOutput();
+            if (nc_tracefile) {
+                dumpTraceFile(nc_tracefile);
+                free(nc_tracefile);
+                nc_tracefile = NULL;
+            }
+            trace_ring_free(&nc_trace);
+        #if defined(__unix__)
+            doneSignals();
+        #if NC_YIELDABLE
+            nc_yieldmode = false;
+        #endif
+            free(nc_watches);
+            nc_watches  = NULL;
+            nc_watchcnt = 0;
+            nc_watchcap = 0;
+            freeRenders();
+            term_mux_done(&nc_termmux);
+            for (int i = 0; i < nc_timertabcap; ++i) {
+                if (nc_timertab[i]) {
+                    releaseTimer(nc_timertab[i]);  /* unlinks it from the timer wheel */
+                }
+            }
+            popExpiredTimer();                     /* frees the released pending timers */
+            free(nc_timertab);
+            nc_timertab     = NULL;
+            nc_timertabcap  = 0;
+            if (nc_readbuffer != nc_readbuffer0) {
+                free(nc_readbuffer);
+                nc_readbuffer = nc_readbuffer0;
+                nc_readcap    = NC_READBUFLEN;
+            }
+        #endif
         }
     }
-#else
-    while (fgetc(stdin) != '\n');
-#endif
     return 0;
 }
 
 /* ============================================================================================ */
 
-static int Nocurses_clrscr(lua_State* L)
+#if defined(__unix__)
+
+/* record types written to the awake pipe */
+enum {
+    NC_REC_WAKE     = 0,  /* wakeup if there is no eventfd */
+    NC_REC_TSTP     = 1,  /* signal records */
+    NC_REC_CONT     = 2,
+    NC_REC_INT      = 3,
+    NC_REC_TERM     = 4,
+    NC_REC_WINCH    = 5,
+    NC_REC_SIGCOUNT,
+    NC_REC_AWAKETAG = NC_REC_SIGCOUNT
+};
+
+static const char* const nc_signames[NC_REC_SIGCOUNT] = {
+    NULL, "TSTP", "CONT", "INT", "TERM", "WINCH"
+};
+
+/* records have fixed size, writes of up to PIPE_BUF bytes are atomic */
+typedef struct {
+    int32_t type;
+    int32_t value;
+} AwakeRecord;
+
+static int            nc_sigpending    = 0;      /* bit mask of received signal records */
+static int            nc_sigcaught     = 0;      /* bit mask of signals caught on request */
+static bool           nc_suspendreq    = false;  /* SIGTSTP received, not yet suspended */
+static bool           nc_tstpcaught    = false;  /* SIGTSTP handler is installed */
+static volatile sig_atomic_t nc_inwait  = 0;      /* main thread is blocked in waitForInput */
+static volatile sig_atomic_t nc_stopped = 0;      /* stopped by the SIGTSTP handler */
+static bool           nc_awakepending  = false;
+static bool           nc_notifypending = false;
+static int32_t*       nc_tags          = NULL;   /* ring of received awake tags */
+static int            nc_tagfirst      = 0;
+static int            nc_tagcnt        = 0;
+static int            nc_tagcap        = 0;
+
+/*
+ * Wakeups from other threads only set a flag, the eventfd (or the awake pipe if 
+ * there is no eventfd) is only written by the first wakeup after the main thread 
+ * has drained it.
+ */
+static int            nc_wakefd        = -1;
+static AtomicCounter  nc_wakepending   = 0;      /* eventfd was written, not yet drained */
+static AtomicCounter  nc_recpending    = 0;      /* records were written to the awake pipe */
+static AtomicCounter  nc_awakeflag     = 0;
+static AtomicCounter  nc_notifyflag    = 0;
+static AtomicCounter  nc_awakewrites   = 0;      /* writes to the eventfd or awake pipe */
+
+/*
+ * Messages posted from any thread are pushed onto a lock-free stack, the main 
+ * thread takes the whole stack at once and appends it in posting order to its 
+ * own message list.
+ */
+typedef struct NcMessage NcMessage;
+
+struct NcMessage {
+    NcMessage* next;
+    int        type;      /* LUA_TSTRING or LUA_TNUMBER */
+    bool       isInt;
+    lua_Integer i;
+    lua_Number  n;
+    size_t     len;
+    char       data[1];
+};
+
+static AtomicPtr      nc_msgstack      = NULL;   /* posted messages, newest first */
+static NcMessage*     nc_msgfirst      = NULL;   /* taken messages, oldest first */
+static NcMessage*     nc_msglast       = NULL;
+
+/*
+ * Notifier objects for the Notify C API. Each notifier counts its notify calls, 
+ * the first call after the last report pushes the notifier onto a lock-free stack 
+ * that is taken by the main thread. Pending notifiers are reported once per source 
+ * with the number of coalesced notify calls.
+ */
+struct notify_notifier {
+    AtomicCounter    refcnt;
+    AtomicCounter    pending;     /* notify calls not yet taken by the main thread */
+    AtomicCounter    queued;      /* 1 while on the notifier stack */
+    lua_Integer      id;
+    notify_notifier* next;        /* link in the notifier stack */
+    notify_notifier* reportnext;  /* link in the report list, main thread only */
+    int              reportcnt;   /* taken notify calls, main thread only */
+    bool             reporting;   /* in the report list, main thread only */
+};
+
+static AtomicPtr        nc_notifierstack = NULL;  /* notified notifiers, newest first */
+static notify_notifier* nc_reportfirst   = NULL;  /* notifiers to report, oldest first */
+static notify_notifier* nc_reportlast    = NULL;
+
+static void sendRecord(int type, int32_t value)
 {
-    clrscr();
-    return 0;
+    if (nc_awake_fds[0] >= 0) {
+      AwakeRecord rec = { type, value };
+      if (write(nc_awake_fds[1], &rec, sizeof(rec)) != sizeof(rec)) {
+        // ignore
+      }
+      atomic_inc(&nc_awakewrites);
+      atomic_set(&nc_recpending, 1);  /* after the write, see drainAwakePipe() */
+    }
 }
 
-/* ============================================================================================ */
-
-static int Nocurses_gotoxy(lua_State* L)
+static void wakeMain()
 {
-    int x = luaL_checkinteger(L, 1);
-    int y = luaL_checkinteger(L, 2);
-    gotoxy(x, y);
-    return 0;
+    if (atomic_get(&nc_wakepending) == 0 && atomic_set(&nc_wakepending, 1) == 0) {
+        if (nc_wakefd >= 0) {
+            uint64_t one = 1;
+            if (write(nc_wakefd, &one, sizeof(one)) != sizeof(one)) {
+              // ignore
+            }
+            atomic_inc(&nc_awakewrites);
+        } else {
+            sendRecord(NC_REC_WAKE, 0);
+        }
+    }
 }
 
-/* ============================================================================================ */
+static void sendAwake()
+{
+    atomic_set(&nc_awakeflag, 1);
+    wakeMain();
+}
 
-static int Nocurses_gotox(lua_State* L)
+static void sendNotify()
 {
-    int x = luaL_checkinteger(L, 1);
-    printf(SEQ(goto_col), x);
-    return 0;
+    atomic_set(&nc_notifyflag, 1);
+    wakeMain();
 }
 
-/* ============================================================================================ */
+static void postMessage(NcMessage* m)
+{
+    NcMessage* head;
+    do {
+        head    = (NcMessage*) atomic_get_ptr(&nc_msgstack);
+        m->next = head;
+    } while (!atomic_set_ptr_if_equal(&nc_msgstack, head, m));
+    wakeMain();
+}
 
-static int Nocurses_up(lua_State* L)
+/* moves posted messages to the message list of the main thread */
+static bool takeMessages()
 {
-    int d = luaL_optinteger(L, 1, 1);
-    if (d > 0) {
-        printf(SEQ(go_up), d);
-    } else if (d < 0) {
-        printf(SEQ(go_down), -d);
+    NcMessage* head;
+    do {
+        head = (NcMessage*) atomic_get_ptr(&nc_msgstack);
+    } while (head && !atomic_set_ptr_if_equal(&nc_msgstack, head, NULL));
+    if (!head) {
+        return false;
     }
-    return 0;
+    NcMessage* reversed = NULL;
+    NcMessage* last     = head;
+    while (head) {
+        NcMessage* next = head->next;
+        head->next = reversed;
+        reversed   = head;
+        head       = next;
+    }
+    if (nc_msglast) {
+        nc_msglast->next = reversed;
+    } else {
+        nc_msgfirst = reversed;
+    }
+    nc_msglast = last;
+    return true;
 }
 
-/* ============================================================================================ */
+static void retainSource(notify_notifier* n)
+{
+    atomic_inc(&n->refcnt);
+}
 
-static int Nocurses_down(lua_State* L)
+static void releaseSource(notify_notifier* n)
 {
-    int d = luaL_optinteger(L, 1, 1);
-    if (d > 0) {
-        printf(SEQ(go_down), d);
-    } else if (d < 0) {
-        printf(SEQ(go_up), -d);
+    if (atomic_dec(&n->refcnt) == 0) {
+        free(n);
     }
-    return 0;
 }
 
-/* ============================================================================================ */
+static void notifySource(notify_notifier* n)
+{
+    atomic_inc(&n->pending);
+    if (atomic_set_if_equal(&n->queued, 0, 1)) {
+        notify_notifier* head;
+        retainSource(n);
+        do {
+            head    = (notify_notifier*) atomic_get_ptr(&nc_notifierstack);
+            n->next = head;
+        } while (!atomic_set_ptr_if_equal(&nc_notifierstack, head, n));
+        wakeMain();
+    }
+}
 
-static int Nocurses_left(lua_State* L)
+/* moves notified notifiers to the report list of the main thread */
+static bool takeNotifiers()
 {
-    int d = luaL_optinteger(L, 1, 1);
-    if (d > 0) {
-        printf(SEQ(go_left), d);
-    } else if (d < 0) {
-        printf(SEQ(go_right), -d);
+    notify_notifier* head;
+    do {
+        head = (notify_notifier*) atomic_get_ptr(&nc_notifierstack);
+    } while (head && !atomic_set_ptr_if_equal(&nc_notifierstack, head, NULL));
+
+    notify_notifier* reversed = NULL;
+    while (head) {
+        notify_notifier* next = head->next;
+        head->next = reversed;
+        reversed   = head;
+        head       = next;
     }
-    return 0;
+    bool found = false;
+    while (reversed) {
+        notify_notifier* n = reversed;
+        reversed = n->next;
+        atomic_set(&n->queued, 0);  /* reset before the count is taken */
+        int cnt = atomic_set(&n->pending, 0);
+        if (cnt > 0) {
+            if (!n->reporting) {
+                retainSource(n);
+                n->reporting  = true;
+                n->reportnext = NULL;
+                if (nc_reportlast) {
+                    nc_reportlast->reportnext = n;
+                } else {
+                    nc_reportfirst = n;
+                }
+                nc_reportlast = n;
+            }
+            n->reportcnt += cnt;
+            found = true;
+        }
+        releaseSource(n);
+    }
+    return found;
 }
 
-/* ============================================================================================ */
+static void freeNotifiers()
+{
+    takeNotifiers();
+    while (nc_reportfirst) {
+        notify_notifier* n = nc_reportfirst;
+        nc_reportfirst = n->reportnext;
+        n->reporting   = false;
+        n->reportcnt   = 0;
+        releaseSource(n);
+    }
+    nc_reportlast = NULL;
+}
 
-static int Nocurses_right(lua_State* L)
+static void freeMessages()
 {
-    int d = luaL_optinteger(L, 1, 1);
-    if (d > 0) {
-        printf(SEQ(go_right), d);
-    } else if (d < 0) {
-        printf(SEQ(go_left), -d);
+    takeMessages();
+    while (nc_msgfirst) {
+        NcMessage* next = nc_msgfirst->next;
+        free(nc_msgfirst);
+        nc_msgfirst = next;
     }
-    return 0;
+    nc_msglast = NULL;
 }
 
-/* ============================================================================================ */
+static void submitRender(ScreenRender* r)
+{
+    r->pendingnext = nc_renderfirst;
+    nc_renderfirst = r;
+    render_pool_submit(&r->job);
+}
 
-static const char* const colors[] =
+/* appends the output of a finished render to its target terminal */
+static void finishRender(ScreenRender* r)
 {
-   "BLACK",   // 0
-   "RED",     // 1
-   "GREEN",   // 2
-   "YELLOW",  // 3
-   "BLUE",    // 4
-   "MAGENTA", // 5
-   "CYAN",    // 6
-   "WHITE",   // 7
-   "DEFAULT", // 8
-    NULL
-};
+    ScreenRender** p = &nc_renderfirst;
+    while (*p != r) {
+        p = &(*p)->pendingnext;
+    }
+    *p = r->pendingnext;
 
-/* ============================================================================================ */
+    if (r->job.failed) {
+        screen_buffer_invalidate(r->sb);  /* shown content is unknown */
+        r->cnt = 0;
+    }
+    else if (r->cnt > 0 && r->term) {
+        Terminal* t = &r->term->term;
+        terminal_write(t, r->job.buf, r->job.len);
+        terminal_write(t, SEQ(reset_attrs), strlen(SEQ(reset_attrs)));
+        if (r->term->mux.index >= 0) {
+            terminal_flush(t);
+            term_mux_update(&nc_termmux, &r->term->mux);
+        }
+    }
+    if (r->again) {
+        r->again = false;
+        r->term  = r->againterm;
+        r->ox    = r->againx;
+        r->oy    = r->againy;
+        submitRender(r);
+        return;
+    }
+    r->sb->render = NULL;
+    screen_buffer_release(r->sb);
+    r->sb = NULL;
+    render_job_done(&r->job);
+
+    r->reportnext = NULL;
+    if (nc_rreportlast) {
+        nc_rreportlast->reportnext = r;
+    } else {
+        nc_rreportfirst = r;
+    }
+    nc_rreportlast = r;
+}
 
-static int Nocurses_setfontcolor(lua_State* L)
+/* returns true if a render has finished that is to be reported */
+static bool takeRenders()
 {
-    int color = luaL_checkoption(L, 1, NULL, colors);
-    if (color == 8) {
-        color = 9; // Default
+    bool       found = false;
+    RenderJob* job   = render_pool_take();
+    while (job) {
+        ScreenRender* r = (ScreenRender*) job;
+        job = job->next;
+        finishRender(r);
+        found = found || !r->sb;
     }
-    setfontcolor(color);
-    return 0;
+    return found;
 }
 
-/* ============================================================================================ */
-
-static int Nocurses_setbgrcolor(lua_State* L)
+static void freeRenders()
 {
-    int color = luaL_checkoption(L, 1, NULL, colors);
-    setbgrcolor(color);
-    return 0;
+    if (nc_renderthreads >= 0) {
+        render_pool_stop();
+        render_pool_take();
+        nc_renderthreads = -1;
+    }
+    while (nc_renderfirst) {
+        ScreenRender* r = nc_renderfirst;
+        nc_renderfirst  = r->pendingnext;
+        r->sb->render   = NULL;
+        screen_buffer_release(r->sb);
+        render_job_done(&r->job);
+        free(r);
+    }
+    while (nc_rreportfirst) {
+        ScreenRender* r = nc_rreportfirst;
+        nc_rreportfirst = r->reportnext;
+        free(r);
+    }
+    nc_rreportlast = NULL;
 }
 
-/* ============================================================================================ */
+static void handleSignal(int sig);
 
-static int Nocurses_setfontbold(lua_State* L)
+/* async-signal-safe output, used from the signal handlers only */
+static void writeSeq(const char* seq, size_t len)
 {
-    luaL_checktype(L, 1, LUA_TBOOLEAN);
-    int flag = lua_toboolean(L, 1);
-    setfontbold(flag);
-    return 0;
+    while (len > 0) {
+        ssize_t n = write(STDOUT_FILENO, seq, len);
+        if (n <= 0) {
+            break;
+        }
+        seq += n;
+        len -= n;
+    }
 }
 
-/* ============================================================================================ */
+#define WRITESEQ(n) writeSeq(SEQ(n), sizeof(SEQ(n)) - 1)
 
-static int Nocurses_setunderline(lua_State* L)
+static void writeMouseSeqs(bool on)
 {
-    luaL_checktype(L, 1, LUA_TBOOLEAN);
-    int flag = lua_toboolean(L, 1);
-    setunderline(flag);
-    return 0;
+    switch (nc_mousemode) {
+        case MOUSE_CLICK:  if (on) WRITESEQ(mouse_click_on);  else WRITESEQ(mouse_click_off);  break;
+        case MOUSE_DRAG:   if (on) WRITESEQ(mouse_drag_on);   else WRITESEQ(mouse_drag_off);   break;
+        case MOUSE_MOTION: if (on) WRITESEQ(mouse_motion_on); else WRITESEQ(mouse_motion_off); break;
+    }
+    if (on) WRITESEQ(mouse_sgr_on); else WRITESEQ(mouse_sgr_off);
+}
+
+/*
+ * SIGTSTP outside of waitForInput, e.g. while a script is busy: the terminal state
+ * is restored and the process stops as soon as the handler returns. Only
+ * async-signal-safe calls are used here, stdio buffers are not touched.
+ */
+static void stopFromHandler()
+{
+    if (nc_hidecur) {
+        WRITESEQ(show_cur);
+    }
+    if (nc_mousemode) {
+        writeMouseSeqs(false);
+    }
+    if (nc_pastemode) {
+        WRITESEQ(paste_off);
+    }
+    if (nc_kbdflags) {
+        WRITESEQ(keyboard_pop);
+    }
+    if (isRaw) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &oldattr);
+    }
+    nc_stopped = 1;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_DFL;
+    sigaction(SIGTSTP, &sa, NULL);
+    raise(SIGTSTP);                  /* blocked until the handler returns */
+}
+
+/* SIGCONT after stopFromHandler(): reapplies the terminal state */
+static void contFromHandler()
+{
+    nc_stopped = 0;
+    if (isRaw) {
+        struct termios newattr = oldattr;
+        newattr.c_lflag &= ~(ICANON | ECHO);
+        tcsetattr(STDIN_FILENO, TCSANOW, &newattr);
+    }
+    if (nc_kbdflags) {
+        char  buf[16];
+        char* p = buf + sizeof(buf);
+        int   f = nc_kbdflags;
+        *--p = 'u';
+        do {
+            *--p = '0' + f % 10;
+            f /= 10;
+        } while (f > 0);
+        *--p = '>';
+        *--p = '[';
+        *--p = '\033';
+        writeSeq(p, buf + sizeof(buf) - p);
+    }
+    if (nc_pastemode) {
+        WRITESEQ(paste_on);
+    }
+    if (nc_mousemode) {
+        writeMouseSeqs(true);
+    }
+    if (nc_hidecur) {
+        WRITESEQ(hide_cur);
+    }
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handleSignal;
+    sa.sa_flags   = SA_RESTART;
+    sigaction(SIGTSTP, &sa, NULL);
+}
+
+static void handleSignal(int sig)
+{
+    int saved = errno;
+    switch (sig) {
+        case SIGTSTP:
+            if (nc_inwait) {
+                sendRecord(NC_REC_TSTP, 0);
+            } else {
+                stopFromHandler();
+            }
+            break;
+        case SIGCONT:
+            if (nc_stopped) {
+                contFromHandler();
+            }
+            sendRecord(NC_REC_CONT, 0);
+            break;
+        case SIGINT:   sendRecord(NC_REC_INT,   0); break;
+        case SIGTERM:  sendRecord(NC_REC_TERM,  0); break;
+        case SIGWINCH: sendRecord(NC_REC_WINCH, 0); break;
+    }
+    errno = saved;
+}
+
+static void initAwake()
+{
+    if (pipe(nc_awake_fds) == 0) {
+        for (int i = 0; i < 2; ++i) {
+            fcntl(nc_awake_fds[i],
+                  F_SETFL,
+                  fcntl(nc_awake_fds[i], F_GETFL) | O_NONBLOCK);
+        }
+        signal(SIGWINCH, handleSignal);  /* set C-signal handlers, SIGTSTP see updateTstpHandler() */
+        signal(SIGCONT,  handleSignal);
+    } else {
+        nc_awake_fds[0] = -1;
+    }
+#if defined(__linux__)
+    /* like the awake pipe, the eventfd is never closed: other threads may still
+     * write to it, it is reused if the module is loaded again */
+    if (nc_wakefd < 0) {
+        nc_wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+#endif
+}
+
+/*
+ * SIGTSTP is only caught while there is terminal state to restore or while the main
+ * thread waits for input, otherwise the default action stops the process.
+ */
+static void updateTstpHandler()
+{
+    bool catchTstp = nc_inwait || isRaw || nc_hidecur || nc_mousemode || nc_pastemode 
+                     || nc_kbdflags;
+    if (catchTstp != nc_tstpcaught && nc_awake_fds[0] >= 0) {
+        signal(SIGTSTP, catchTstp ? handleSignal : SIG_DFL);
+        nc_tstpcaught = catchTstp;
+    }
+}
+
+static void doneSignals()
+{
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGCONT, SIG_DFL);
+    nc_tstpcaught = false;
+    if (nc_sigcaught & (1 << NC_REC_INT)) {
+        signal(SIGINT, SIG_DFL);
+    }
+    if (nc_sigcaught & (1 << NC_REC_TERM)) {
+        signal(SIGTERM, SIG_DFL);
+    }
+    nc_sigcaught     = 0;
+    nc_sigpending    = 0;
+    nc_suspendreq    = false;
+    nc_awakepending  = false;
+    nc_notifypending = false;
+    free(nc_tags);
+    nc_tags     = NULL;
+    nc_tagfirst = 0;
+    nc_tagcnt   = 0;
+    nc_tagcap   = 0;
+    freeMessages();
+    freeNotifiers();
+}
+
+static void pushTag(int32_t tag)
+{
+    if (nc_tagcnt == nc_tagcap) {
+        int      newcap = nc_tagcap ? 2 * nc_tagcap : 16;
+        int32_t* tags   = (int32_t*) malloc(newcap * sizeof(int32_t));
+        if (!tags) {
+            nc_awakepending = true;  /* tag is lost, report untagged awake */
+            return;
+        }
+        for (int i = 0; i < nc_tagcnt; ++i) {
+            tags[i] = nc_tags[(nc_tagfirst + i) % nc_tagcap];
+        }
+        free(nc_tags);
+        nc_tags     = tags;
+        nc_tagfirst = 0;
+        nc_tagcap   = newcap;
+    }
+    nc_tags[(nc_tagfirst + nc_tagcnt++) % nc_tagcap] = tag;
+}
+
+/* true if there are received events from the awake pipe not yet reported */
+static bool hasPendingEvent()
+{
+    return nc_sigpending || nc_tagcnt > 0 || nc_awakepending || nc_notifypending 
+        || nc_replayend || nc_msgfirst || nc_reportfirst || nc_rreportfirst 
+        || nc_termmux.readyfirst;
+}
+
+/* 
+ * Collects wakeup flags and reads all records from the awake pipe, returns true if 
+ * there were any to be reported. The pending flags are reset before the flags and
+ * the records are read, so that no wakeup is lost.
+ */
+static bool drainAwakePipe()
+{
+    bool hasAwake = false;
+    if (atomic_get(&nc_wakepending)) {
+        atomic_set(&nc_wakepending, 0);
+        if (nc_wakefd >= 0) {
+            uint64_t cnt;
+            if (read(nc_wakefd, &cnt, sizeof(cnt)) < 0) {
+                // ignore
+            }
+        }
+        if (atomic_get(&nc_awakeflag) && atomic_set(&nc_awakeflag, 0)) {
+            nc_awakepending = true;
+            hasAwake        = true;
+        }
+        if (atomic_get(&nc_notifyflag) && atomic_set(&nc_notifyflag, 0)) {
+            nc_notifypending = true;
+            hasAwake         = true;
+        }
+        atomic_set(&nc_readerwake, 0);  /* reset before the ring is checked */
+        if (takeMessages()) {
+            hasAwake = true;
+        }
+        if (takeNotifiers()) {
+            hasAwake = true;
+        }
+        if (takeRenders()) {
+            hasAwake = true;
+        }
+    }
+    const int afd = nc_awake_fds[0];
+    if (afd >= 0 && atomic_get(&nc_recpending)) {
+        atomic_set(&nc_recpending, 0);
+        AwakeRecord buf[32];
+        ssize_t     n;
+        while ((n = read(afd, buf, sizeof(buf))) > 0) {
+            for (size_t i = 0; i < n / sizeof(AwakeRecord); ++i) {
+                const AwakeRecord* rec = buf + i;
+                if (rec->type == NC_REC_WAKE) {
+                    continue;  /* flags are already collected */
+                }
+                hasAwake = true;
+                if (rec->type == NC_REC_AWAKETAG) {
+                    pushTag(rec->value);
+                }
+                else if (rec->type > NC_REC_WAKE && rec->type < NC_REC_SIGCOUNT) {
+                    nc_sigpending |= (1 << rec->type);
+                    if (rec->type == NC_REC_TSTP) {
+                        nc_suspendreq = true;
+                    }
+                }
+            }
+        }
+    }
+    return hasAwake;
+}
+
+/* 
+ * Restores the terminal state, stops the process and reapplies the terminal
+ * state after the process was continued.
+ */
+static void suspendProcess()
+{
+    TRACE_CALL();
+    nc_suspendreq = false;
+
+    bool wasRaw    = isRaw;
+    int  mousemode = nc_mousemode;
+    if (nc_hidecur) {
+        PUTSEQ(show_cur);
+    }
+    if (mousemode) {
+        setMouseMode(0);
+    }
+    if (nc_pastemode) {
+        PUTSEQ(paste_off);
+    }
+    if (nc_kbdflags) {
+        PUTSEQ(keyboard_pop);
+    }
+    if (wasRaw) {
+        switchRaw(false);
+    }
+    flushOutput();
+
+    signal(SIGTSTP, SIG_DFL);
+    raise(SIGTSTP);                  /* returns after SIGCONT */
+    signal(SIGTSTP, nc_tstpcaught ? handleSignal : SIG_DFL);
+
+    if (wasRaw) {
+        switchRaw(true);
+    }
+    if (nc_kbdflags) {
+        PRINTSEQ(keyboard_push, nc_kbdflags);
+    }
+    if (nc_pastemode) {
+        PUTSEQ(paste_on);
+    }
+    if (mousemode) {
+        setMouseMode(mousemode);
+    }
+    if (nc_hidecur) {
+        PUTSEQ(hide_cur);
+    }
+    flushOutput();
+}
+
+/* seconds from monotonic clock */
+static double getTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* milliseconds from monotonic clock, one tick of the timer wheel */
+static uint64_t getTicks()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)(ts.tv_nsec / 1000000);
+}
+
+static void handleExpiredTimer(TimerNode* node, void* data)
+{
+    NcTimer* t   = (NcTimer*)node;
+    uint64_t now = *(uint64_t*)data;
+    if (!t->pending) {
+        t->pending     = true;
+        t->nextPending = NULL;
+        if (nc_pendinglast) {
+            nc_pendinglast->nextPending = t;
+        } else {
+            nc_pendingfirst = t;
+        }
+        nc_pendinglast = t;
+    }
+    if (t->interval > 0) {
+        uint64_t next = node->expires + t->interval;
+        if (next <= now) {
+            next = now + t->interval; /* skip missed ticks */
+        }
+        timer_wheel_add(&nc_timerwheel, node, next);
+    }
+}
+
+static bool hasExpiredTimer()
+{
+    uint64_t now = getTicks();
+    timer_wheel_advance(&nc_timerwheel, now, handleExpiredTimer, &now);
+    return nc_pendingfirst != NULL;
+}
+
+/* removes timer from table, the memory is freed when it is no longer pending */
+static void releaseTimer(NcTimer* t)
+{
+    nc_timertab[t->index] = NULL;
+    timer_wheel_remove(&nc_timerwheel, &t->node);
+    if (t->pending) {
+        t->canceled = true;
+    } else {
+        free(t);
+    }
+}
+
+static NcTimer* popExpiredTimer()
+{
+    while (nc_pendingfirst) {
+        NcTimer* t = nc_pendingfirst;
+        nc_pendingfirst = t->nextPending;
+        if (!nc_pendingfirst) {
+            nc_pendinglast = NULL;
+        }
+        t->pending = false;
+        if (t->canceled) {
+            free(t);
+        } else {
+            return t;
+        }
+    }
+    return NULL;
+}
+
+static bool hasInputAt(int i)
+{
+    return (nc_readpos + i < nc_readlen);
+}
+
+static void clearInput()
+{
+    nc_readpos = 0;
+    nc_readlen = 0;
+}
+
+static bool hasInput()
+{
+    return (nc_readpos < nc_readlen);
+}
+
+/* true if the reader thread has delivered input or end of input */
+static bool hasReaderInput()
+{
+    return nc_chunkleft > 0 || nc_readereof || spsc_ring_used(&nc_readerring) > 0;
+}
+
+/* ============================================================================================ */
+
+static void putU32(FILE* f, uint32_t v)
+{
+    unsigned char b[4] = { v & 0xFF, (v >> 8) & 0xFF, (v >> 16) & 0xFF, (v >> 24) & 0xFF };
+    fwrite(b, 1, 4, f);
+}
+
+static bool getU32(FILE* f, uint32_t* v)
+{
+    unsigned char b[4];
+    if (fread(b, 1, 4, f) != 4) {
+        return false;
+    }
+    *v = (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+    return true;
+}
+
+static void recordChunk(const unsigned char* buf, size_t len, double time)
+{
+    double   delay = (time - nc_recordlast) * 1e6;
+    uint32_t us    = (delay <= 0) ? 0 : (delay >= UINT32_MAX) ? UINT32_MAX : (uint32_t)delay;
+    putU32(nc_recordfile, us);
+    putU32(nc_recordfile, (uint32_t)len);
+    fwrite(buf, 1, len, nc_recordfile);
+    nc_recordlast = time;
+}
+
+static void stopRecord()
+{
+    if (nc_recordfile) {
+        fclose(nc_recordfile);
+        nc_recordfile = NULL;
+    }
+}
+
+static void stopReplay()
+{
+    if (nc_replayfile) {
+        fclose(nc_replayfile);
+        nc_replayfile = NULL;
+        nc_replayleft = 0;
+        nc_replayend  = true;
+    }
+}
+
+/* reads the header of the next chunk, stops the replay at end of file */
+static void loadReplayChunk()
+{
+    uint32_t us, len;
+    if (!getU32(nc_replayfile, &us) || !getU32(nc_replayfile, &len)) {
+        stopReplay();
+        return;
+    }
+    nc_replayleft = len;
+    nc_replaydue  = nc_replaymax ? 0 : nc_replaydue + (double)us / 1e6;
+    if (len == 0) {
+        loadReplayChunk();
+    }
+}
+
+/* true if the current chunk of the replay is due */
+static bool hasReplayInput()
+{
+    return nc_replayleft > 0 && getTime() >= nc_replaydue;
+}
+
+/* seconds until the current chunk of the replay is due */
+static double replayDelay()
+{
+    double delay = nc_replaydue - getTime();
+    return (delay > 0) ? delay : 0;
+}
+
+static ssize_t readReplay(unsigned char* buf, size_t len)
+{
+    if (!hasReplayInput()) {
+        errno = EAGAIN;
+        return -1;
+    }
+    size_t n = (len < (size_t)nc_replayleft) ? len : (size_t)nc_replayleft;
+    if (fread(buf, 1, n, nc_replayfile) != n) {
+        stopReplay();
+        errno = EIO;
+        return -1;
+    }
+    nc_replayleft -= n;
+    if (nc_replayleft == 0) {
+        loadReplayChunk();
+    }
+    return n;
+}
+
+/* ============================================================================================ */
+
+/* true if stdin is not read directly but through the reader thread or a replay */
+static bool hasInputSource()
+{
+    return nc_replayfile || nc_readeron;
+}
+
+static bool hasSourceInput()
+{
+    return nc_replayfile ? hasReplayInput() : nc_readeron && hasReaderInput();
+}
+
+/* 
+ * Unregisters a watched fd that was closed while registered, select fails for
+ * such a fd. The fd is reported as ready with NC_WATCH_CLOSED.
+ */
+static void takeClosedWatch()
+{
+    for (int i = 0; i < nc_watchcnt; ++i) {
+        int fd = nc_watches[i].fd;
+        if (fcntl(fd, F_GETFD) == -1 && errno == EBADF) {
+            nc_watches[i]  = nc_watches[--nc_watchcnt];
+            nc_watchnext   = 0;
+            nc_readyfd     = fd;
+            nc_readyevents = NC_WATCH_CLOSED;
+            return;
+        }
+    }
+}
+
+static bool waitForInput(double timeout, bool withTimers)
+{
+    nc_readyfd     = -1;
+    nc_readyevents = 0;
+
+    if (drainAwakePipe() || nc_suspendreq) {
+        if (nc_suspendreq) {
+            suspendProcess();
+        }
+        return false;
+    }
+    if (withTimers && (hasPendingEvent() || hasExpiredTimer())) {
+        return false;
+    }
+    if (hasSourceInput()) {
+        return true;
+    }
+
+    const int ifd  = STDIN_FILENO;
+    const int afd  = nc_awake_fds[0];
+    const int wfd  = nc_wakefd;
+    int       nfds = (ifd > afd ? ifd : afd) + 1;
+    if (wfd >= nfds) {
+        nfds = wfd + 1;
+    }
+
+    nc_inwait = 1;
+    updateTstpHandler();
+
+    /* in raw mode the terminal settings are already suitable */
+    struct termios oldattr, newattr;
+    if (!isRaw) {
+        tcgetattr(STDIN_FILENO, &oldattr);
+    
+        newattr = oldattr;
+        newattr.c_lflag &= ~(ICANON | ECHO);
+        tcsetattr(STDIN_FILENO, TCSANOW, &newattr);
+        nc_stats.termios += 1;
+    }
+
+    uint64_t deadline = TIMER_WHEEL_NEVER;
+    if (timeout >= 0.0) {
+        deadline = getTicks() + (uint64_t)(timeout * 1000);
+    }
+    bool hasInp = false;
+    while (true) {
+        int       ret  = 0;
+        fd_set    fds;
+        fd_set    wfds;
+        FD_ZERO(&fds);
+        FD_ZERO(&wfds);
+        if (!hasInputSource()) {
+            FD_SET(ifd, &fds);
+        }
+        if (afd >= 0) {
+            FD_SET(afd, &fds);
+        }
+        if (wfd >= 0) {
+            FD_SET(wfd, &fds);
+        }
+        for (int i = 0; i < nc_watchcnt; ++i) {
+            const WatchEntry* w = nc_watches + i;
+            if (w->events & NC_WATCH_READ) {
+                FD_SET(w->fd, &fds);
+            }
+            if (w->events & NC_WATCH_WRITE) {
+                FD_SET(w->fd, &wfds);
+            }
+            if (w->fd >= nfds) {
+                nfds = w->fd + 1;
+            }
+        }
+        term_mux_prepare(&nc_termmux, &fds, &wfds, &nfds);
+        /* the nearest timer deadline shortens the select timeout */
+        double   waitTime   = timeout;
+        bool     timerFirst = false;
+        if (withTimers) {
+            uint64_t next = timer_wheel_next(&nc_timerwheel);
+            if (next != TIMER_WHEEL_NEVER && next < deadline) {
+                uint64_t now = getTicks();
+                waitTime   = (next > now) ? (double)(next - now) / 1000 : 0.0;
+                timerFirst = true;
+            }
+        }
+        if (nc_replayfile) {
+            double delay = replayDelay();
+            if (waitTime < 0.0 || delay < waitTime) {
+                waitTime = delay;
+            }
+        }
+        if (waitTime < 0.0) {
+           ret = select(nfds, &fds, &wfds, NULL, NULL);
+        } else {
+            const long     sec  = (long)waitTime;
+            const long     usec = (long)((waitTime - (double)sec) * 1e6);
+            struct timeval tv   = {sec, usec};
+            ret                 = select(nfds, &fds, &wfds, NULL, &tv);
+        }
+        bool hasSignal = (ret == -1) && (errno == EINTR);
+        if (ret == -1 && errno == EBADF) {
+            takeClosedWatch();
+        }
+        bool hasAwake  = (ret > 0) && (   (afd >= 0 && FD_ISSET(afd, &fds))
+                                       || (wfd >= 0 && FD_ISSET(wfd, &fds)));
+        hasInp         = (ret > 0) && (FD_ISSET(ifd, &fds));
+        if (ret > 0 && afd >= 0 && FD_ISSET(afd, &fds)) {
+            atomic_set(&nc_recpending, 1);  /* the record may be visible before the flag */
+        }
+        if (ret > 0 && wfd >= 0 && FD_ISSET(wfd, &fds)) {
+            atomic_set(&nc_wakepending, 1);  /* the eventfd is read even if the flag was reset */
+        }
+        if (hasAwake || hasSignal) {
+            hasAwake = drainAwakePipe();
+        }
+        if (hasInputSource()) {
+            hasInp = hasSourceInput();
+        }
+        nc_stats.waits += 1;
+        if (ret == 0)  nc_stats.waketimeout += 1;
+        if (hasSignal) nc_stats.wakesignal  += 1;
+        if (hasInp)    nc_stats.wakeinput   += 1;
+        if (hasAwake)  nc_stats.wakeawake   += 1;
+        if (ret > 0 && !hasInp && !hasAwake) {
+            nc_stats.wakeother += 1;  /* watched fds, terminals or spurious */
+        }
+        bool hasTerm = (ret > 0) && term_mux_collect(&nc_termmux, &fds, &wfds);
+        if (ret > 0 && !hasInp) {
+            /* report one ready fd per wakeup, round robin, select is level triggered
+             * so the other ready fds are reported again on the next wait */
+            for (int j = 0; j < nc_watchcnt; ++j) {
+                const int         i  = (nc_watchnext + j) % nc_watchcnt;
+                const WatchEntry* w  = nc_watches + i;
+                int               ev = 0;
+                if ((w->events & NC_WATCH_READ) && FD_ISSET(w->fd, &fds)) {
+                    ev |= NC_WATCH_READ;
+                }
+                if ((w->events & NC_WATCH_WRITE) && FD_ISSET(w->fd, &wfds)) {
+                    ev |= NC_WATCH_WRITE;
+                }
+                if (ev) {
+                    nc_readyfd     = w->fd;
+                    nc_readyevents = ev;
+                    nc_watchnext   = (i + 1) % nc_watchcnt;
+                    break;
+                }
+            }
+        }
+        /* woken up for input that was already consumed from the reader ring,
+         * for terminal output that was written without completing or for a 
+         * render that was followed by a coalesced render */
+        bool spurious = (nc_readeron || hasTerm || nc_renderfirst) && ret > 0 && !hasInp && !hasAwake 
+                        && nc_readyfd < 0 && !nc_termmux.readyfirst;
+        /* woken up before the next chunk of the replay is due */
+        bool early    = nc_replayfile && ret == 0 && !hasInp 
+                        && (deadline == TIMER_WHEEL_NEVER || getTicks() < deadline);
+        if (   hasInp || (ret != 0 && !spurious) || (!timerFirst && !early && !spurious)
+            || (timerFirst && hasExpiredTimer())) 
+        {
+            break;
+        }
+        /* woken up for cascading timers, spurious or early: wait again */
+        if (deadline != TIMER_WHEEL_NEVER) {
+            uint64_t now = getTicks();
+            timeout = (deadline > now) ? (double)(deadline - now) / 1000 : 0.0;
+        }
+    }
+    if (!isRaw) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &oldattr);
+        nc_stats.termios += 1;
+    }
+    if (nc_suspendreq) {
+        suspendProcess();
+    }
+    nc_inwait = 0;
+    updateTstpHandler();
+    return hasInp;
+}
+
+/* pushes the reason for the last wakeup without input, returns number of pushed values */
+static int pushWakeup(lua_State* L)
+{
+    if (nc_sigpending) {
+        for (int i = NC_REC_WAKE + 1; i < NC_REC_SIGCOUNT; ++i) {
+            if (nc_sigpending & (1 << i)) {
+                nc_sigpending &= ~(1 << i);
+                lua_pushliteral(L, "signal");
+                lua_pushstring(L, nc_signames[i]);
+                return 2;
+            }
+        }
+    }
+    if (nc_tagcnt > 0) {
+        lua_pushliteral(L, "awake");
+        lua_pushinteger(L, nc_tags[nc_tagfirst]);
+        nc_tagfirst = (nc_tagfirst + 1) % nc_tagcap;
+        nc_tagcnt  -= 1;
+        return 2;
+    }
+    if (nc_awakepending) {
+        nc_awakepending = false;
+        lua_pushliteral(L, "awake");
+        return 1;
+    }
+    if (nc_notifypending) {
+        nc_notifypending = false;
+        lua_pushliteral(L, "notify");
+        return 1;
+    }
+    if (nc_reportfirst) {
+        notify_notifier* n = nc_reportfirst;
+        nc_reportfirst = n->reportnext;
+        if (!nc_reportfirst) {
+            nc_reportlast = NULL;
+        }
+        lua_pushliteral(L, "notify");
+        lua_pushinteger(L, n->id);
+        lua_pushinteger(L, n->reportcnt);
+        n->reporting = false;
+        n->reportcnt = 0;
+        releaseSource(n);
+        return 3;
+    }
+    if (nc_msgfirst) {
+        NcMessage* m = nc_msgfirst;
+        nc_msgfirst  = m->next;
+        if (!nc_msgfirst) {
+            nc_msglast = NULL;
+        }
+        lua_pushliteral(L, "message");
+        if (m->type == LUA_TSTRING) {
+            lua_pushlstring(L, m->data, m->len);
+        } else if (m->isInt) {
+            lua_pushinteger(L, m->i);
+        } else {
+            lua_pushnumber(L, m->n);
+        }
+        free(m);
+        return 2;
+    }
+    if (nc_replayend) {
+        nc_replayend = false;
+        lua_pushliteral(L, "replay");
+        return 1;
+    }
+    if (nc_rreportfirst) {
+        ScreenRender* r = nc_rreportfirst;
+        nc_rreportfirst = r->reportnext;
+        if (!nc_rreportfirst) {
+            nc_rreportlast = NULL;
+        }
+        lua_pushliteral(L, "rendered");
+        lua_pushinteger(L, r->id);
+        lua_pushinteger(L, r->cnt);
+        free(r);
+        return 3;
+    }
+    if (nc_termmux.readyfirst) {
+        TermMuxEntry* e = nc_termmux.readyfirst;
+        lua_pushliteral(L, "term");
+        lua_rawgetp(L, LUA_REGISTRYINDEX, &nc_termmux);
+        lua_rawgetp(L, -1, e);
+        lua_remove(L, -2);
+        if (e->events & TERM_MUX_INPUT) {
+            e->events &= ~TERM_MUX_INPUT;
+            lua_pushliteral(L, "input");
+        } else if (e->events & TERM_MUX_DRAINED) {
+            e->events &= ~TERM_MUX_DRAINED;
+            lua_pushliteral(L, "drained");
+        } else {
+            e->events &= ~TERM_MUX_CLOSED;
+            lua_pushliteral(L, "closed");
+        }
+        if (!e->events) {
+            term_mux_next(&nc_termmux);
+        }
+        return 3;
+    }
+    if (nc_readyfd >= 0) {
+        lua_pushliteral(L, "fd");
+        lua_pushinteger(L, nc_readyfd);
+        switch (nc_readyevents) {
+            case NC_WATCH_READ:                  lua_pushliteral(L, "r");  break;
+            case NC_WATCH_WRITE:                 lua_pushliteral(L, "w");  break;
+            case NC_WATCH_CLOSED:                lua_pushliteral(L, "closed"); break;
+            default:                             lua_pushliteral(L, "rw"); break;
+        }
+        nc_readyfd = -1;
+        return 3;
+    }
+    return 0;
+}
+
+/* like pushWakeup, also reports expired timers */
+static int pushWakeupOrTimer(lua_State* L)
+{
+    int n = pushWakeup(L);
+    if (n == 0) {
+        NcTimer* t = popExpiredTimer();
+        if (t) {
+            lua_pushliteral(L, "timer");
+            lua_pushinteger(L, t->id);
+            if (t->interval == 0) {
+                releaseTimer(t);
+            }
+            n = 2;
+        }
+    }
+    return n;
+}
+
+#endif /* __unix__ */
+
+/* ============================================================================================ */
+
+static int Nocurses_wait(lua_State* L)
+{
+    TRACE_CALL();
+    clearInput();
+#if defined(__unix__)
+    while (true) {
+        if (waitForInput(-1, false)) {
+            if (fgetc(stdin) == '\n') {
+                break;
+            }
+        } else {
+            break;
+        }
+    }
+#else
+    while (fgetc(stdin) != '\n');
+#endif
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_clrscr(lua_State* L)
+{
+    TRACE_CALL();
+    PUTSEQ(clear_screen);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_gotoxy(lua_State* L)
+{
+    TRACE_CALL();
+    int x = luaL_checkinteger(L, 1);
+    int y = luaL_checkinteger(L, 2);
+    PRINTSEQ(goto_row_col, y, x);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_gotox(lua_State* L)
+{
+    TRACE_CALL();
+    int x = luaL_checkinteger(L, 1);
+    PRINTSEQ(goto_col, x);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_up(lua_State* L)
+{
+    TRACE_CALL();
+    int d = luaL_optinteger(L, 1, 1);
+    if (d > 0) {
+        PRINTSEQ(go_up, d);
+    } else if (d < 0) {
+        PRINTSEQ(go_down, -d);
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_down(lua_State* L)
+{
+    TRACE_CALL();
+    int d = luaL_optinteger(L, 1, 1);
+    if (d > 0) {
+        PRINTSEQ(go_down, d);
+    } else if (d < 0) {
+        PRINTSEQ(go_up, -d);
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_left(lua_State* L)
+{
+    TRACE_CALL();
+    int d = luaL_optinteger(L, 1, 1);
+    if (d > 0) {
+        PRINTSEQ(go_left, d);
+    } else if (d < 0) {
+        PRINTSEQ(go_right, -d);
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_right(lua_State* L)
+{
+    TRACE_CALL();
+    int d = luaL_optinteger(L, 1, 1);
+    if (d > 0) {
+        PRINTSEQ(go_right, d);
+    } else if (d < 0) {
+        PRINTSEQ(go_left, -d);
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static const char* const colors[] =
+{
+   "BLACK",   // 0
+   "RED",     // 1
+   "GREEN",   // 2
+   "YELLOW",  // 3
+   "BLUE",    // 4
+   "MAGENTA", // 5
+   "CYAN",    // 6
+   "WHITE",   // 7
+   "DEFAULT", // 8
+    NULL
+};
+
+/* ============================================================================================ */
+
+static int Nocurses_setfontcolor(lua_State* L)
+{
+    TRACE_CALL();
+    int color = luaL_checkoption(L, 1, NULL, colors);
+    if (color == 8) {
+        color = 9; // Default
+    }
+    PRINTSEQ(set_foregrd_color, color);
+    font_color = color;
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_setbgrcolor(lua_State* L)
+{
+    TRACE_CALL();
+    int color = luaL_checkoption(L, 1, NULL, colors);
+    PRINTSEQ(set_backgrd_color, color);
+    bg_color = color;
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_setfontbold(lua_State* L)
+{
+    TRACE_CALL();
+    luaL_checktype(L, 1, LUA_TBOOLEAN);
+    int flag = lua_toboolean(L, 1);
+    SETATTR(font_bold, flag, set_attr_bold);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_setunderline(lua_State* L)
+{
+    TRACE_CALL();
+    luaL_checktype(L, 1, LUA_TBOOLEAN);
+    int flag = lua_toboolean(L, 1);
+    SETATTR(font_underline, flag, set_attr_underline);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_setblink(lua_State* L)
+{
+    TRACE_CALL();
+    luaL_checktype(L, 1, LUA_TBOOLEAN);
+    int flag = lua_toboolean(L, 1);
+    SETATTR(font_blink, flag, set_attr_blink);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_setinvert(lua_State* L)
+{
+    TRACE_CALL();
+    luaL_checktype(L, 1, LUA_TBOOLEAN);
+    int flag = lua_toboolean(L, 1);
+    SETATTR(font_invert, flag, set_attr_inverse);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_settitle(lua_State* L)
+{
+    TRACE_CALL();
+    const char* title = luaL_checkstring(L, 1);
+    PRINTSEQ(set_title, title);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static const char* const shapes[] =
+{
+    "DEFAULT",
+    "BLOCK_BLINK",
+    "BLOCK",
+    "UNDERLINE_BLINK",
+    "UNDERLINE",
+    "BAR_BLINK",
+    "BAR",
+    NULL
+};
+
+static int Nocurses_setcurshape(lua_State* L)
+{
+    TRACE_CALL();
+    int shape = luaL_checkoption(L, 1, NULL, shapes);
+    PRINTSEQ(set_cur_shape, shape);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_gettermsize(lua_State* L)
+{
+    struct termsize s = gettermsize();
+    lua_pushinteger(L, s.cols);
+    lua_pushinteger(L, s.rows);
+    return 2;
+}
+
+/* ============================================================================================ */
+
+#if defined(__unix__)
+
+/* all terminal input is read here */
+/* reads from the current chunk of the reader ring */
+static ssize_t readReaderRing(unsigned char* buf, size_t len, double* time)
+{
+    if (nc_chunkleft == 0) {
+        if (nc_readereof) {
+            return 0;
+        }
+        if (spsc_ring_used(&nc_readerring) == 0) {
+            errno = EAGAIN;
+            return -1;
+        }
+        InputChunk c;
+        spsc_ring_read(&nc_readerring, &c, sizeof(c));
+        nc_stats.reads     += 1;  /* each chunk was obtained by one read() */
+        nc_stats.readbytes += c.len;
+        if (c.len == 0) {
+            nc_readereof = true;
+            return 0;
+        }
+        nc_chunkleft = c.len;
+        nc_chunktime = c.time;
+    }
+    int n = (len < (size_t)nc_chunkleft) ? (int)len : nc_chunkleft;
+    spsc_ring_read(&nc_readerring, buf, n);
+    nc_chunkleft -= n;
+    *time         = nc_chunktime;
+    return n;
+}
+
+static ssize_t readInput(unsigned char* buf, size_t len)
+{
+    double  time = -1;
+    ssize_t n;
+    if (nc_replayfile) {
+        n = readReplay(buf, len);
+    } else {
+        if (nc_readeron) {
+            n = readReaderRing(buf, len, &time);
+        } else {
+            n = read(STDIN_FILENO, buf, len);
+            nc_stats.reads += 1;
+            if (n > 0) {
+                nc_stats.readbytes += n;
+            }
+        }
+        if (n > 0 && time < 0) {
+            time = getTime();
+        }
+        if (n > 0 && nc_recordfile) {
+            recordChunk(buf, n, time);
+        }
+    }
+    if (n > 0) {
+        if (time < 0) {
+            time = getTime();
+        }
+        nc_streamend += n;
+        if (nc_stampcnt == NC_INPUTSTAMPS) {
+            /* merge into newest entry, i.e. the bytes get the earlier time */
+            nc_stamps[(nc_stampfirst + nc_stampcnt - 1) % NC_INPUTSTAMPS].end = nc_streamend;
+        } else {
+            InputStamp* e = &nc_stamps[(nc_stampfirst + nc_stampcnt++) % NC_INPUTSTAMPS];
+            e->end  = nc_streamend;
+            e->time = time;
+        }
+        if (nc_trace.cap > 0) {
+            trace_ring_record(&nc_trace, time, TRACE_INPUT, nc_tracetag, buf, n);
+        }
+    }
+    return n;
+}
+
+/* 
+ * Returns the time when the byte at position pos in nc_readbuffer was read and
+ * records it as time of the last obtained input. Stamps of the bytes before 
+ * are discarded.
+ */
+static double inputTime(size_t pos)
+{
+    uint64_t spos = nc_streamend - (nc_readlen - pos);
+    while (nc_stampcnt > 1 && nc_stamps[nc_stampfirst].end <= spos) {
+        nc_stampfirst = (nc_stampfirst + 1) % NC_INPUTSTAMPS;
+        nc_stampcnt  -= 1;
+    }
+    if (nc_stampcnt > 0) {
+        nc_inputtime = nc_stamps[nc_stampfirst].time;
+    }
+    return nc_inputtime;
+}
+
+static int nc_getch()
+{
+    if (nc_readpos < nc_readlen) {
+        return nc_readbuffer[nc_readpos++];
+    }
+    ssize_t len = readInput(nc_readbuffer, nc_readcap);
+    if (len > 0) {
+        nc_readpos = 1;
+        nc_readlen = len;
+        return nc_readbuffer[0];
+    }
+    else {
+        clearInput();
+        return -1;
+    }
+}
+
+static int nc_peekch(int offs)
+{
+    if (nc_readpos + offs < nc_readlen) {
+        return nc_readbuffer[nc_readpos + offs];
+    }
+    if (nc_readpos > 0 && nc_readpos < nc_readlen) {
+        memmove(nc_readbuffer, nc_readbuffer + nc_readpos, nc_readlen - nc_readpos);
+        nc_stats.memmoves     += 1;
+        nc_stats.memmovebytes += nc_readlen - nc_readpos;
+        nc_readlen -= nc_readpos;
+        nc_readpos = 0;
+    } else {
+        nc_readlen = 0;
+        nc_readpos = 0;
+    }   
+    if (nc_readlen < nc_readcap) {
+        ssize_t len = readInput(nc_readbuffer + nc_readlen, nc_readcap - nc_readlen);
+        if (len > 0) {
+            nc_readlen += len;
+        }
+    }
+    if (nc_readpos + offs < nc_readlen) {
+        return nc_readbuffer[nc_readpos + offs];
+    }
+    else {
+        return -1;
+    }
+}
+
+static int nc_skipch(int skip)
+{
+    if (nc_readpos + skip <= nc_readlen) {
+        nc_readpos += skip;
+        return skip;
+    }
+    if (nc_readpos > 0 && nc_readpos < nc_readlen) {
+        memmove(nc_readbuffer, nc_readbuffer + nc_readpos, nc_readlen - nc_readpos);
+        nc_stats.memmoves     += 1;
+        nc_stats.memmovebytes += nc_readlen - nc_readpos;
+        nc_readlen -= nc_readpos;
+        nc_readpos = 0;
+    } else {
+        nc_readlen = 0;
+        nc_readpos = 0;
+    }   
+    if (nc_readlen < nc_readcap) {
+        ssize_t len = readInput(nc_readbuffer + nc_readlen, nc_readcap - nc_readlen);
+        if (len > 0) {
+            nc_readlen += len;
+        }
+    }
+    if (nc_readpos + skip <= nc_readlen) {
+        nc_readpos += skip;
+        return skip;
+    }
+    else {
+        skip = nc_readlen - nc_readpos;
+        nc_readpos = 0;
+        nc_readlen = 0;
+        return skip;
+    }
+}
+
+/* puts bytes in front of the input queue */
+static bool nc_unreadch(const unsigned char* bytes, size_t n)
+{
+    size_t remaining = nc_readlen - nc_readpos;
+    if (remaining + n > nc_readcap) {
+        size_t         newcap = remaining + n;
+        unsigned char* newbuf = (unsigned char*) malloc(newcap);
+        if (!newbuf) {
+            return false;
+        }
+        memcpy(newbuf + n, nc_readbuffer + nc_readpos, remaining);
+        if (nc_readbuffer != nc_readbuffer0) {
+            free(nc_readbuffer);
+        }
+        nc_readbuffer = newbuf;
+        nc_readcap    = newcap;
+    } else {
+        memmove(nc_readbuffer + n, nc_readbuffer + nc_readpos, remaining);
+        nc_stats.memmoves     += 1;
+        nc_stats.memmovebytes += remaining;
+    }
+    memcpy(nc_readbuffer, bytes, n);
+    nc_readpos = 0;
+    nc_readlen = remaining + n;
+    return true;
+}
+
+/* puts bytes at the end of the input queue */
+static bool nc_appendch(const unsigned char* bytes, size_t n)
+{
+    size_t remaining = nc_readlen - nc_readpos;
+    if (remaining + n > nc_readcap) {
+        size_t         newcap = remaining + n;
+        unsigned char* newbuf = (unsigned char*) malloc(newcap);
+        if (!newbuf) {
+            return false;
+        }
+        memcpy(newbuf, nc_readbuffer + nc_readpos, remaining);
+        if (nc_readbuffer != nc_readbuffer0) {
+            free(nc_readbuffer);
+        }
+        nc_readbuffer = newbuf;
+        nc_readcap    = newcap;
+    } else {
+        memmove(nc_readbuffer, nc_readbuffer + nc_readpos, remaining);
+        nc_stats.memmoves     += 1;
+        nc_stats.memmovebytes += remaining;
+    }
+    memcpy(nc_readbuffer + remaining, bytes, n);
+    nc_readpos = 0;
+    nc_readlen = remaining + n;
+    return true;
+}
+
+/* ============================================================================================ */
+
+/* reads stdin into the reader ring until stopped or end of input */
+static void* readerMain(void* arg)
+{
+    unsigned char buf[sizeof(InputChunk) + NC_READERCHUNK];
+    const int     ifd  = STDIN_FILENO;
+    const int     sfd  = nc_readerstop[0];
+    const int     nfds = (ifd > sfd ? ifd : sfd) + 1;
+    while (true) {
+        bool   full = spsc_ring_space(&nc_readerring) < (int)sizeof(buf);
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(sfd, &fds);
+        if (!full) {
+            FD_SET(ifd, &fds);
+        }
+        struct timeval tv  = { 0, 10000 };  /* polls for space if the ring is full */
+        int            ret = select(nfds, &fds, NULL, NULL, full ? &tv : NULL);
+        if (ret > 0 && FD_ISSET(sfd, &fds)) {
+            break;
+        }
+        if (ret > 0 && FD_ISSET(ifd, &fds)) {
+            ssize_t n = read(ifd, buf + sizeof(InputChunk), NC_READERCHUNK);
+            if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+                continue;
+            }
+            InputChunk c = { (n > 0) ? (int)n : 0, getTime() };
+            memcpy(buf, &c, sizeof(c));
+            spsc_ring_write(&nc_readerring, buf, sizeof(c) + c.len);
+            if (atomic_get(&nc_readerwake) == 0 && atomic_set(&nc_readerwake, 1) == 0) {
+                wakeMain();
+            }
+            if (n <= 0) {
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+static bool startReader()
+{
+    if (nc_awake_fds[0] < 0 || !spsc_ring_init(&nc_readerring, NC_READERRING)) {
+        return false;
+    }
+    if (pipe(nc_readerstop) != 0) {
+        spsc_ring_free(&nc_readerring);
+        return false;
+    }
+    /* signals are handled by the main thread only */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int rc = pthread_create(&nc_readerthread, NULL, readerMain, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0) {
+        close(nc_readerstop[0]);
+        close(nc_readerstop[1]);
+        spsc_ring_free(&nc_readerring);
+        return false;
+    }
+    /* already buffered input is delivered before the input of the reader thread */
+    nc_chunkleft = 0;
+    nc_readereof = false;
+    nc_readeron  = true;
+    return true;
+}
+
+static void stopReader()
+{
+    if (nc_readeron) {
+        char c = 0;
+        if (write(nc_readerstop[1], &c, 1) != 1) {
+            // ignore
+        }
+        pthread_join(nc_readerthread, NULL);
+        close(nc_readerstop[0]);
+        close(nc_readerstop[1]);
+        /* input that was read by the thread but not yet obtained is kept */
+        unsigned char buf[NC_READERCHUNK];
+        ssize_t       n;
+        while ((n = readInput(buf, sizeof(buf))) > 0) {
+            nc_appendch(buf, n);
+        }
+        nc_readeron = false;
+        spsc_ring_free(&nc_readerring);
+        nc_chunkleft = 0;
+        nc_readereof = false;
+        atomic_set(&nc_readerwake, 0);
+    }
+}
+
+/* ============================================================================================ */
+
+/* waits until the input byte at offs is available, deadline in ticks */
+static int nc_peekuntil(int offs, uint64_t deadline)
+{
+    while (!hasInputAt(offs)) {
+        uint64_t now = getTicks();
+        if (!waitForInput(deadline > now ? (double)(deadline - now) / 1000 : 0.0, false)) {
+            if (getTicks() >= deadline) {
+                return -1;
+            }
+            continue; /* interrupted by awake or signal */
+        }
+        size_t avail = nc_readlen - nc_readpos;
+        if (nc_peekch(offs) < 0 && nc_readlen - nc_readpos <= avail) {
+            return -1; /* end of input or input queue is full */
+        }
+    }
+    return nc_readbuffer[nc_readpos + offs];
+}
+
+/* ============================================================================================ */
+
+#define MOUSE_SHIFT   0x04
+#define MOUSE_ALT     0x08
+#define MOUSE_CTRL    0x10
+#define MOUSE_MOTION_FLAG  0x20
+#define MOUSE_WHEEL   0x40
+#define MOUSE_EXTRA   0x80
+
+typedef struct {
+    int  cb;
+    int  x;
+    int  y;
+    bool release;
+    int  rawpos;  /* position of report in the input queue */
+    int  rawlen;
+} MouseReport;
+
+/*
+ * Parses the body "Cb;Cx;Cy(M|m)" of a SGR mouse report following ESC [ <. 
+ * Returns the number of bytes parsed, 0 if incomplete, -1 if invalid.
+ */
+static int parseMouseReport(const unsigned char* p, size_t len, MouseReport* r)
+{
+    int    values[3] = {0, 0, 0};
+    int    n         = 0;
+    bool   digits    = false;
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = p[i];
+        if (c >= '0' && c <= '9') {
+            if (values[n] > 100000) {
+                return -1;
+            }
+            values[n] = 10 * values[n] + (c - '0');
+            digits    = true;
+        }
+        else if (c == ';' && digits && n < 2) {
+            ++n;
+            digits = false;
+        }
+        else if ((c == 'M' || c == 'm') && digits && n == 2) {
+            r->cb      = values[0];
+            r->x       = values[1];
+            r->y       = values[2];
+            r->release = (c == 'm');
+            r->rawlen  = i + 1;
+            return i + 1;
+        }
+        else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static bool isMotionReport(const MouseReport* r)
+{
+    return !r->release && (r->cb & MOUSE_MOTION_FLAG) && !(r->cb & MOUSE_WHEEL);
+}
+
+/*
+ * Input queue of stdin or of a terminal object, for assembling key sequences. The
+ * fields are referenced, waiting for more input may move the buffer.
+ */
+typedef struct InputQueue InputQueue;
+
+struct InputQueue {
+    unsigned char** buf;
+    size_t*         pos;
+    size_t*         len;
+    void*           ctx;
+    /* waits until more than avail bytes are queued, returns false if no more
+     * bytes are available until the deadline (in ticks) */
+    bool          (*wait)(InputQueue* q, size_t avail, uint64_t deadline);
+};
+
+/*
+ * Replaces a motion report by directly following motion reports with the same 
+ * button and modifier state that are already in the input queue.
+ */
+static void coalesceMotion(InputQueue* q, MouseReport* r)
+{
+    const size_t introLen = sizeof(SEQ(mouse_sgr_report)) - 1;
+    while (isMotionReport(r)) {
+        size_t avail = *q->len - *q->pos;
+        const unsigned char* p = *q->buf + *q->pos;
+        if (avail <= introLen || memcmp(p, SEQ(mouse_sgr_report), introLen) != 0) {
+            break;
+        }
+        MouseReport next;
+        int len = parseMouseReport(p + introLen, avail - introLen, &next);
+        if (len <= 0 || !isMotionReport(&next) || next.cb != r->cb) {
+            break;
+        }
+        next.rawpos = *q->pos;
+        next.rawlen = introLen + len;
+        *r = next;
+        *q->pos += introLen + len;
+    }
+}
+
+static const char* mouseModifiers(int cb)
+{
+    static const char* const names[] = {
+        "",      "Shift",      "Alt",      "Shift+Alt",
+        "Ctrl",  "Shift+Ctrl", "Alt+Ctrl", "Shift+Alt+Ctrl"
+    };
+    return names[(cb >> 2) & 0x07];
+}
+
+static int pushMouseReport(lua_State* L, const MouseReport* r)
+{
+    int cb     = r->cb;
+    int button = (cb & 0x03) + 1;
+    const char* action;
+    if (cb & MOUSE_WHEEL) {
+        button = (cb & 0x03) + 4;  /* 4: up, 5: down, 6: left, 7: right */
+        action = "wheel";
+    }
+    else if (cb & MOUSE_EXTRA) {
+        button = (cb & 0x03) + 8;
+        action = r->release ? "release" : "press";
+    }
+    else if (r->release) {
+        action = "release";
+    }
+    else if (cb & MOUSE_MOTION_FLAG) {
+        action = "motion";
+    }
+    else {
+        action = "press";
+    }
+    if (button == 4 && !(cb & (MOUSE_WHEEL|MOUSE_EXTRA))) {
+        button = 0; /* no button pressed, e.g. motion or release in X10 style */
+    }
+    lua_pushinteger(L, r->x);
+    lua_pushinteger(L, r->y);
+    lua_pushinteger(L, button);
+    lua_pushstring(L, action);
+    lua_pushstring(L, mouseModifiers(cb));
+    return 5;
+}
+/* ============================================================================================ */
+
+#define NC_PASTECHUNK 65536
+
+typedef struct {
+    unsigned char* data;
+    size_t         len;
+    size_t         cap;
+} PasteBuffer;
+
+static bool reservePaste(PasteBuffer* p, size_t n)
+{
+    if (p->len + n > p->cap) {
+        size_t newcap = p->cap ? 2 * p->cap : NC_PASTECHUNK;
+        while (newcap < p->len + n) {
+            newcap *= 2;
+        }
+        unsigned char* newdata = (unsigned char*) realloc(p->data, newcap);
+        if (!newdata) {
+            return false;
+        }
+        p->data = newdata;
+        p->cap  = newcap;
+    }
+    return true;
+}
+
+/* returns position of the paste end marker or -1, memchr is vectorized by the C library */
+static ptrdiff_t findPasteEnd(const unsigned char* data, size_t len, size_t from)
+{
+    const size_t mlen = sizeof(SEQ(paste_end)) - 1;
+    while (from + mlen <= len) {
+        const unsigned char* esc = (const unsigned char*) memchr(data + from, 0x1B, len - mlen + 1 - from);
+        if (!esc) {
+            break;
+        }
+        if (memcmp(esc, SEQ(paste_end), mlen) == 0) {
+            return esc - data;
+        }
+        from = (esc - data) + 1;
+    }
+    return -1;
+}
+
+/*
+ * Reads pasted text up to the paste end marker into p, returns true if the
+ * marker was found. Bytes following the marker remain in the input queue.
+ */
+static bool readPaste(PasteBuffer* p, double timeout)
+{
+    const size_t mlen  = sizeof(SEQ(paste_end)) - 1;
+    size_t       avail = nc_readlen - nc_readpos;
+    if (!reservePaste(p, avail + NC_PASTECHUNK)) {
+        return false;
+    }
+    memcpy(p->data, nc_readbuffer + nc_readpos, avail);
+    p->len = avail;
+    clearInput();
+
+    size_t   from     = 0;
+    uint64_t deadline = getTicks() + (uint64_t)(timeout * 1000);
+    while (true) {
+        ptrdiff_t end = findPasteEnd(p->data, p->len, from);
+        if (end >= 0) {
+            size_t after = end + mlen;
+            if (after < p->len) {
+                nc_unreadch(p->data + after, p->len - after);
+            }
+            p->len = end;
+            return true;
+        }
+        from = (p->len >= mlen) ? p->len - mlen + 1 : 0;
+        if (!waitForInput(timeout, false)) {
+            uint64_t now = getTicks();
+            if (now >= deadline) {
+                return false;
+            }
+            timeout = (double)(deadline - now) / 1000;
+            continue;   /* interrupted by awake or signal */
+        }
+        if (!reservePaste(p, NC_PASTECHUNK)) {
+            return false;
+        }
+        ssize_t n = readInput(p->data + p->len, NC_PASTECHUNK);
+        if (n <= 0) {
+            return false;
+        }
+        p->len  += n;
+        deadline = getTicks() + (uint64_t)(timeout * 1000);
+    }
+}
+
+/* ============================================================================================ */
+
+/*
+ * Determines the length of the key sequence at the head of the input queue, see
+ * key_sequence_length(). Outstanding bytes are awaited until the deadline (in ticks)
+ * that covers the whole sequence. The sequence is not consumed.
+ */
+static int assembleSequence(InputQueue* q, uint64_t deadline)
+{
+    while (true) {
+        size_t avail = *q->len - *q->pos;
+        int    n     = key_sequence_length(*q->buf + *q->pos, avail, false);
+        if (n > 0) {
+            return n;
+        }
+        if (!q->wait(q, avail, deadline)) {
+            return key_sequence_length(*q->buf + *q->pos, *q->len - *q->pos, true);
+        }
+    }
+}
+
+/*
+ * Consumes the key sequence at the head of the input queue, directly following 
+ * mouse motion reports are coalesced. Returns the length of the resulting sequence,
+ * its position in the queue is stored in start.
+ */
+static int takeSequence(InputQueue* q, uint64_t deadline, size_t* start)
+{
+    int    len = assembleSequence(q, deadline);
+    size_t pos = *q->pos;
+    *q->pos += len;
+    const size_t introLen = sizeof(SEQ(mouse_sgr_report)) - 1;
+    MouseReport  r;
+    if (   len > (int)introLen && memcmp(*q->buf + pos, SEQ(mouse_sgr_report), introLen) == 0
+        && parseMouseReport(*q->buf + pos + introLen, len - introLen, &r) > 0)
+    {
+        r.rawpos = pos;
+        r.rawlen = len;
+        coalesceMotion(q, &r);
+        pos = r.rawpos;
+        len = r.rawlen;
+    }
+    *start = pos;
+    return len;
+}
+
+static bool waitStdinInput(InputQueue* q, size_t avail, uint64_t deadline)
+{
+    return nc_peekuntil(avail, deadline) >= 0;
+}
+
+static InputQueue nc_stdinqueue = { &nc_readbuffer, &nc_readpos, &nc_readlen, NULL, waitStdinInput };
+
+#endif
+
+/* ============================================================================================ */
+
+static int assureUnrestricted(lua_State* L)
+{
+    bool restricted = true;
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, NOCURSES_MODULE_NAME) == LUA_TUSERDATA) { // -> nocurses
+        if (lua_touserdata(L, -1) == udata) {                                       // -> nocurses
+            restricted = false;
+        }
+    }
+    lua_pop(L, 1); // -> 
+    if (restricted) {
+        return luaL_error(L, "function must be called from main thread");
+    }
+    else {
+        return 0;
+    }
+}
+
+/* ============================================================================================ */
+
+#if defined(__unix__)
+
+static int pushGetch(lua_State* L, double timeout)
+{
+    bool hasInp = hasInput() || waitForInput(timeout, true);
+    if (hasInp) {
+        int c = nc_getch();
+        if (c >= 0) {
+            inputTime(nc_readpos - 1);
+            lua_pushinteger(L, c);
+            return 1;
+        } else {
+            lua_pushnil(L);
+            return 1;
+        }
+    } else {
+        lua_pushnil(L);
+        return 1 + pushWakeupOrTimer(L);
+    }
+}
+
+static int pushGetseq(lua_State* L, double timeout, double timeout2)
+{
+    bool hasInp = hasInput() || waitForInput(timeout, true);
+    if (hasInp && nc_peekch(0) >= 0) {
+        size_t pos;
+        int    len = takeSequence(&nc_stdinqueue, getTicks() + (uint64_t)(timeout2 * 1000), &pos);
+        inputTime(pos);
+        lua_pushlstring(L, (const char*)nc_readbuffer + pos, len);
+        return 1;
+    } else {
+        lua_pushnil(L);
+        return 1 + pushWakeupOrTimer(L);
+    }
+}
+
+/* true if input or a wakeup reason is available without waiting */
+static bool hasReadyInput()
+{
+    return hasInput() || nc_readyfd >= 0 || hasPendingEvent() || nc_pendingfirst != NULL;
+}
+
+#if NC_YIELDABLE
+
+enum {
+    WAIT_GETCH  = 0,
+    WAIT_GETSEQ = 1
+};
+
+/* true if the calling coroutine is suspended instead of blocking the Lua state */
+static bool canYield(lua_State* L)
+{
+    if (!nc_yieldmode) {
+        return false;
+    }
+#if LUA_VERSION_NUM >= 503
+    return lua_isyieldable(L);
+#else
+    bool isMain = lua_pushthread(L);
+    lua_pop(L, 1);
+    return !isMain;
+#endif
+}
+
+/*
+ * Continuation of a suspended getch or getseq, the stack holds the deadline and 
+ * timeout2. Input and wakeup reasons are only obtained from the input buffer and 
+ * the pending events, waiting is done by nocurses.poll() for all coroutines.
+ */
+LUA_KFUNCTION(continueWait)
+{
+    lua_settop(L, 2);                                  /* -> deadline, timeout2 */
+    double deadline = lua_tonumber(L, 1);
+    double timeout2 = lua_tonumber(L, 2);
+    if (hasReadyInput()) {
+        return (ctx == WAIT_GETCH) ? pushGetch(L, 0) : pushGetseq(L, 0, timeout2);
+    }
+    double remaining = -1;
+    if (deadline >= 0) {
+        remaining = deadline - getTime();
+        if (remaining <= 0) {
+            lua_pushnil(L);
+            return 1;
+        }
+    }
+    lua_pushliteral(L, "nocurses.wait");               /* -> deadline, timeout2, "nocurses.wait" */
+    if (remaining >= 0) {
+        lua_pushnumber(L, remaining);                  /* -> deadline, timeout2, "nocurses.wait", remaining */
+    } else {
+        lua_pushnil(L);                                /* -> deadline, timeout2, "nocurses.wait", nil */
+    }
+    return lua_yieldk(L, 2, ctx, continueWait);
+}
+
+static int startWait(lua_State* L, int kind, double timeout, double timeout2)
+{
+    /* the first check is done here, afterwards by nocurses.poll() */
+    if (waitForInput(0, true) || hasReadyInput()) {
+        return (kind == WAIT_GETCH) ? pushGetch(L, 0) : pushGetseq(L, 0, timeout2);
+    }
+    lua_settop(L, 0);
+    lua_pushnumber(L, (timeout >= 0) ? getTime() + timeout : -1);
+    lua_pushnumber(L, timeout2);                       /* -> deadline, timeout2 */
+    return continueWait(L, LUA_OK, kind);
+}
+
+#endif /* NC_YIELDABLE */
+
+#endif /* __unix__ */
+
+/* ============================================================================================ */
+
+static int Nocurses_getch(lua_State* L)
+{
+    TRACE_CALL();
+    flushOutput();
+
+    assureUnrestricted(L);
+
+    double timeout = -1;
+    if (!lua_isnoneornil(L, 1)) {
+        timeout = luaL_checknumber(L, 1);
+        if (timeout < 0){
+            timeout = 0;
+        }
+    }
+#if defined(__unix__)
+#if NC_YIELDABLE
+    if (canYield(L) && !hasReadyInput()) {
+        return startWait(L, WAIT_GETCH, timeout, 0);
+    }
+#endif
+    return pushGetch(L, timeout);
+#else
+    lua_pushinteger(L, getch());
+    return 1;
+#endif
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_peekch(lua_State* L)
+{
+    TRACE_CALL();
+    flushOutput();
+
+    assureUnrestricted(L);
+
+    int offs = 0;
+    if (!lua_isnoneornil(L, 1)) {
+        offs = luaL_checkinteger(L, 1) - 1;
+        if (offs < 0 || offs >= NC_READBUFLEN) {
+            return luaL_argerror(L, 1, "invalid offset");
+        }
+    }
+    double timeout = 0;
+    if (!lua_isnoneornil(L, 2)) {
+        timeout = luaL_checknumber(L, 2);
+        if (timeout < 0){
+            timeout = 0;
+        }
+    }
+#if defined(__unix__)
+    bool hasInp = hasInputAt(offs) || waitForInput(timeout, false);
+    if (hasInp) {
+        int c = nc_peekch(offs);
+        if (c >= 0) {
+            lua_pushinteger(L, c);
+        } else {
+            lua_pushnil(L);
+        }
+    } else {
+        lua_pushnil(L);
+        return 1 + pushWakeup(L);
+    }
+#else
+    lua_pushnil(L);
+#endif
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_skipch(lua_State* L)
+{
+    TRACE_CALL();
+    flushOutput();
+
+    assureUnrestricted(L);
+
+    int skip = 1;
+    if (!lua_isnoneornil(L, 1)) {
+        skip = luaL_checkinteger(L, 1) ;
+    }
+    if (skip <= 0) {
+        lua_pushinteger(L, 0);
+        return 1;
+    }
+#if defined(__unix__)
+    bool hasInp = hasInputAt(skip - 1) || waitForInput(0 /* timeout */, false);
+    if (hasInp) {
+        int skipped = nc_skipch(skip);
+        lua_pushinteger(L, skipped);
+    } else {
+        lua_pushinteger(L, 0);
+    }
+#else
+    lua_pushnil(L);
+#endif
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_setmouse(lua_State* L)
+{
+    TRACE_CALL();
+    static const char* const modes[] = { "OFF", "CLICK", "DRAG", "MOTION", NULL };
+
+    assureUnrestricted(L);
+
+    int mode = luaL_checkoption(L, 1, NULL, modes);
+#if defined(__unix__)
+    setMouseMode(mode);
+    updateTstpHandler();
+#endif
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_decodemouse(lua_State* L)
+{
+    size_t      len;
+    const char* bytes    = luaL_checklstring(L, 1, &len);
+    size_t      introLen = sizeof(SEQ(mouse_sgr_report)) - 1;
+    MouseReport r;
+    if (   len > introLen && memcmp(bytes, SEQ(mouse_sgr_report), introLen) == 0
+        && parseMouseReport((const unsigned char*)bytes + introLen, len - introLen, &r) 
+           == (int)(len - introLen))
+    {
+        return pushMouseReport(L, &r);
+    }
+    lua_pushnil(L);
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_getseq(lua_State* L)
+{
+    TRACE_CALL();
+    flushOutput();
+
+    assureUnrestricted(L);
+
+    double timeout = -1;
+    if (!lua_isnoneornil(L, 1)) {
+        timeout = luaL_checknumber(L, 1);
+        if (timeout < 0){
+            timeout = 0;
+        }
+    }
+    double timeout2 = luaL_optnumber(L, 2, 0.050);
+    if (timeout2 < 0) {
+        timeout2 = 0;
+    }
+#if defined(__unix__)
+#if NC_YIELDABLE
+    if (canYield(L) && !hasReadyInput()) {
+        return startWait(L, WAIT_GETSEQ, timeout, timeout2);
+    }
+#endif
+    return pushGetseq(L, timeout, timeout2);
+#else
+    lua_pushnil(L);
+    return 1;
+#endif
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_setpaste(lua_State* L)
+{
+    TRACE_CALL();
+    assureUnrestricted(L);
+
+    bool enable = true;
+    if (!lua_isnoneornil(L, 1)) {
+        enable = lua_toboolean(L, 1);
+    }
+#if defined(__unix__)
+    if (enable != nc_pastemode) {
+        if (enable) {
+            PUTSEQ(paste_on);
+        } else {
+            PUTSEQ(paste_off);
+        }
+        nc_pastemode = enable;
+        updateTstpHandler();
+    }
+#endif
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_getpaste(lua_State* L)
+{
+    TRACE_CALL();
+    flushOutput();
+
+    assureUnrestricted(L);
+
+    double timeout = 1.0;
+    if (!lua_isnoneornil(L, 1)) {
+        timeout = luaL_checknumber(L, 1);
+        if (timeout < 0){
+            timeout = 0;
+        }
+    }
+#if defined(__unix__)
+    PasteBuffer p = { NULL, 0, 0 };
+    bool complete = readPaste(&p, timeout);
+    lua_pushlstring(L, (const char*)p.data, p.len);
+    lua_pushboolean(L, complete);
+    free(p.data);
+    return 2;
+#else
+    lua_pushnil(L);
+    return 1;
+#endif
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_setkeyboard(lua_State* L)
+{
+    TRACE_CALL();
+    assureUnrestricted(L);
+
+    int flags = luaL_optinteger(L, 1, 1);
+    if (flags < 0 || flags > 31) {
+        return luaL_argerror(L, 1, "invalid flags");
+    }
+#if defined(__unix__)
+    if (flags != nc_kbdflags) {
+        if (!nc_kbdflags) {
+            PRINTSEQ(keyboard_push, flags);
+        } else if (!flags) {
+            PUTSEQ(keyboard_pop);
+        } else {
+            PRINTSEQ(keyboard_set, flags);
+        }
+        nc_kbdflags = flags;
+        updateTstpHandler();
+    }
+#endif
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_decodekey(lua_State* L)
+{
+    size_t      len;
+    const char* seq = luaL_checklstring(L, 1, &len);
+    KeyEvent    ev;
+    if (key_decode_csi(seq, len, &ev)) {
+        if (ev.isText && (ev.mods & ~KEY_MOD_SHIFT) == 0) {
+            lua_pushboolean(L, false);
+            lua_pushstring(L, key_event_name(ev.event));
+            lua_pushstring(L, ev.key);
+        } else {
+            lua_pushstring(L, ev.name);
+            lua_pushstring(L, key_event_name(ev.event));
+            lua_pushnil(L);
+        }
+        return 3;
+    }
+    lua_pushnil(L);
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_setcoalesce(lua_State* L)
+{
+    assureUnrestricted(L);
+
+    bool enable = true;
+    if (!lua_isnoneornil(L, 1)) {
+        enable = lua_toboolean(L, 1);
+    }
+    nc_coalesce = enable;
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_skiprepeat(lua_State* L)
+{
+    TRACE_CALL();
+    assureUnrestricted(L);
+
+    size_t      len;
+    const char* bytes = luaL_checklstring(L, 1, &len);
+    lua_Integer count = 1;
+#if defined(__unix__)
+    if (nc_coalesce && len > 0) {
+        /* only input that has already been read is coalesced */
+        while (nc_readlen - nc_readpos >= len 
+            && memcmp(nc_readbuffer + nc_readpos, bytes, len) == 0)
+        {
+            nc_readpos += len;
+            count      += 1;
+        }
+    }
+#endif
+    lua_pushinteger(L, count);
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_clrline(lua_State* L)
+{
+    TRACE_CALL();
+    PUTSEQ(clear_line);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_clrtoeol(lua_State* L)
+{
+    TRACE_CALL();
+    PUTSEQ(clear_to_eol);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_clrtoeos(lua_State* L)
+{
+    TRACE_CALL();
+    PUTSEQ(clear_to_eos);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_resetcolors(lua_State* L)
+{
+    TRACE_CALL();
+    PUTSEQ(reset_attrs);
+    bg_color       = 9;
+    font_color     = 9;
+    font_bold      = 0;
+    font_underline = 0;
+    font_blink     = 0;
+    font_invert    = 0;
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_showcursor(lua_State* L)
+{
+    TRACE_CALL();
+    assureUnrestricted(L);
+    
+    nc_hidecur = false;
+    PUTSEQ(show_cur);
+#if defined(__unix__)
+    updateTstpHandler();
+#endif
+
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_hidecursor(lua_State* L)
+{
+    TRACE_CALL();
+    assureUnrestricted(L);
+
+    nc_hidecur = true;
+    PUTSEQ(hide_cur);
+#if defined(__unix__)
+    updateTstpHandler();
+#endif
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_setraw(lua_State* L)
+{
+    assureUnrestricted(L);
+    
+    bool raw = true;
+    
+    if (!lua_isnoneornil(L, 1)) {
+        raw = lua_toboolean(L, 1);
+    }
+    
+    switchRaw(raw);
+#if defined(__unix__)
+    updateTstpHandler();
+#endif
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_now(lua_State* L)
+{
+#if defined(__unix__)
+    lua_pushnumber(L, getTime());
+#else
+    lua_pushnumber(L, (double)GetTickCount64() / 1000);
+#endif
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_inputtime(lua_State* L)
+{
+    assureUnrestricted(L);
+
+#if defined(__unix__)
+    if (nc_inputtime >= 0) {
+        lua_pushnumber(L, nc_inputtime);
+        return 1;
+    }
+#endif
+    lua_pushnil(L);
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_israw(lua_State* L)
+{
+    assureUnrestricted(L);
+    
+    lua_pushboolean(L, isRaw);
+    
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_isatty(lua_State* L)
+{
+    assureUnrestricted(L);
+    
+    luaL_Stream* stream = (luaL_Stream*) luaL_checkudata(L, 1, LUA_FILEHANDLE);
+    
+    if (stream->f) {
+        lua_pushboolean(L, isatty(fileno(stream->f)));
+    } else {
+        lua_pushboolean(L, false);
+    }
+    
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static void setStat(lua_State* L, const char* name, uint64_t value)
+{
+    lua_pushinteger(L, (lua_Integer)value);
+    lua_setfield(L, -2, name);
+}
+
+/* pushes the subtable with the given name of the table on top of the stack */
+static void pushStatTable(lua_State* L, const char* name)
+{
+    lua_getfield(L, -1, name);
+    if (!lua_istable(L, -1)) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_setfield(L, -3, name);
+    }
+}
+
+static int Nocurses_stats(lua_State* L)
+{
+    assureUnrestricted(L);
+
+    if (lua_istable(L, 1)) {
+        lua_settop(L, 1);  /* refill the given table */
+    } else {
+        lua_settop(L, 0);
+        lua_newtable(L);
+    }
+    setStat(L, "bytes",        nc_stats.outbytes);
+    setStat(L, "flushes",      nc_stats.flushes);
+    setStat(L, "writes",       nc_stats.writes);
+    setStat(L, "reads",        nc_stats.reads);
+    setStat(L, "readbytes",    nc_stats.readbytes);
+    setStat(L, "waits",        nc_stats.waits);
+    setStat(L, "termios",      nc_stats.termios);
+    setStat(L, "memmoves",     nc_stats.memmoves);
+    setStat(L, "memmovebytes", nc_stats.memmovebytes);
+#if defined(__unix__)
+    setStat(L, "awakewrites",  (unsigned)atomic_get(&nc_awakewrites));
+#else
+    setStat(L, "awakewrites",  0);
+#endif
+
+    pushStatTable(L, "wakeups");
+    setStat(L, "input",   nc_stats.wakeinput);
+    setStat(L, "awake",   nc_stats.wakeawake);
+    setStat(L, "signal",  nc_stats.wakesignal);
+    setStat(L, "timeout", nc_stats.waketimeout);
+    setStat(L, "other",   nc_stats.wakeother);
+    lua_pop(L, 1);
+
+    for (int k = 0; k < 2; ++k) {
+        const uint64_t* values = (k == 0) ? nc_stats.seqcount : nc_stats.seqbytes;
+        pushStatTable(L, (k == 0) ? "sequences" : "sequencebytes");
+        for (int i = 0; i < SEQ_COUNT; ++i) {
+            if (nc_stats.seqcount[i] > 0) {
+                lua_pushinteger(L, (lua_Integer)values[i]);
+            } else {
+                lua_pushnil(L);  /* removes values of a refilled table after reset */
+            }
+            lua_setfield(L, -2, seqNames[i]);
+        }
+        lua_pop(L, 1);
+    }
+    return 1;
+}
+
+static int Nocurses_resetstats(lua_State* L)
+{
+    assureUnrestricted(L);
+
+    memset(&nc_stats, 0, sizeof(nc_stats));
+#if defined(__unix__)
+    atomic_set(&nc_awakewrites, 0);
+#endif
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int Nocurses_trace(lua_State* L)
+{
+    lua_Integer size = luaL_checkinteger(L, 1);
+    const char* file = luaL_optstring(L, 2, NULL);
+
+    assureUnrestricted(L);
+    luaL_argcheck(L, size >= 0, 1, "size must not be negative");
+
+    char* name = NULL;
+    if (file && size > 0) {
+        size_t len = strlen(file);
+        name = (char*) malloc(len + 1);
+        if (!name) {
+            return luaL_error(L, "out of memory");
+        }
+        memcpy(name, file, len + 1);
+    }
+    trace_ring_free(&nc_trace);
+    if (size > 0 && !trace_ring_init(&nc_trace, (size_t)size)) {
+        free(name);
+        return luaL_error(L, "out of memory");
+    }
+    free(nc_tracefile);
+    nc_tracefile = name;
+    return 0;
+}
+
+static int Nocurses_dumptrace(lua_State* L)
+{
+    assureUnrestricted(L);
+
+    if (lua_isnoneornil(L, 1)) {
+        luaL_Buffer b;
+        luaL_buffinit(L, &b);
+        trace_ring_dump(&nc_trace, writeTraceToBuffer, &b);
+        luaL_pushresult(&b);
+        return 1;
+    }
+    if (lua_type(L, 1) == LUA_TSTRING) {
+        const char* name = lua_tostring(L, 1);
+        return luaL_fileresult(L, dumpTraceFile(name), name);
+    }
+    luaL_Stream* stream = (luaL_Stream*) luaL_checkudata(L, 1, LUA_FILEHANDLE);
+    if (!stream->f) {
+        return luaL_argerror(L, 1, "attempt to use a closed file");
+    }
+    trace_ring_dump(&nc_trace, writeTraceToFile, stream->f);
+    lua_pushboolean(L, true);
+    return 1;
+}
+
+/* ============================================================================================ */
+
+#if defined(__unix__)    
+
+static int Nocurses_awake(lua_State* L)
+{
+    if (lua_isnoneornil(L, 1)) {
+        sendAwake();
+    } else {
+        lua_Integer tag = luaL_checkinteger(L, 1);
+        if (tag < INT32_MIN || tag > INT32_MAX) {
+            return luaL_argerror(L, 1, "tag out of range");
+        }
+        sendRecord(NC_REC_AWAKETAG, (int32_t)tag);
+    }
+    return 0;
+}
+
+static int Nocurses_post(lua_State* L)
+{
+    int         type = lua_type(L, 1);
+    size_t      len  = 0;
+    const char* str  = NULL;
+    if (type == LUA_TSTRING) {
+        str = lua_tolstring(L, 1, &len);
+    } else if (type != LUA_TNUMBER) {
+        return luaL_argerror(L, 1, "string or number expected");
+    }
+    if (atomic_get(&initStage) != 1) {
+        lua_pushboolean(L, false);  /* main state is closed */
+        return 1;
+    }
+    NcMessage* m = (NcMessage*) malloc(sizeof(NcMessage) + len);
+    if (!m) {
+        return luaL_error(L, "out of memory");
+    }
+    m->type = type;
+    m->len  = len;
+    if (type == LUA_TSTRING) {
+        memcpy(m->data, str, len);
+    } else {
+        m->isInt = lua_isinteger(L, 1);
+        m->i     = m->isInt ? lua_tointeger(L, 1) : 0;
+        m->n     = lua_tonumber(L, 1);
+    }
+    postMessage(m);
+    lua_pushboolean(L, true);
+    return 1;
+}
+
+static int Nocurses_poll(lua_State* L)
+{
+    TRACE_CALL();
+    flushOutput();
+
+    assureUnrestricted(L);
+
+    double timeout = -1;
+    if (!lua_isnoneornil(L, 1)) {
+        timeout = luaL_checknumber(L, 1);
+        if (timeout < 0){
+            timeout = 0;
+        }
+    }
+    bool ready = hasReadyInput();
+    if (!ready) {
+        if (waitForInput(timeout, true)) {
+            nc_peekch(0);   /* read input into the buffer for the suspended coroutines */
+        }
+        ready = hasReadyInput();
+    }
+    lua_pushboolean(L, ready);
+    return 1;
+}
+
+static int Nocurses_setyield(lua_State* L)
+{
+    assureUnrestricted(L);
+
+    bool enable = lua_isnoneornil(L, 1) || lua_toboolean(L, 1);
+#if NC_YIELDABLE
+    nc_yieldmode = enable;
+#else
+    if (enable) {
+        return luaL_error(L, "yieldable waits require Lua 5.2 or newer");
+    }
+#endif
+    return 0;
+}
+
+static int Nocurses_record(lua_State* L)
+{
+    assureUnrestricted(L);
+
+    const char* fileName = luaL_optstring(L, 1, NULL);
+    stopRecord();
+    if (fileName) {
+        nc_recordfile = fopen(fileName, "wb");
+        if (!nc_recordfile) {
+            return luaL_error(L, "cannot open file '%s': %s", fileName, strerror(errno));
+        }
+        fwrite(NC_RECORD_MAGIC, 1, sizeof(NC_RECORD_MAGIC) - 1, nc_recordfile);
+        nc_recordlast = getTime();
+    }
+    return 0;
+}
+
+static int Nocurses_replay(lua_State* L)
+{
+    static const char* const speeds[] = { "ORIGINAL", "MAX", NULL };
+
+    assureUnrestricted(L);
+
+    const char* fileName = luaL_optstring(L, 1, NULL);
+    int         speed    = luaL_checkoption(L, 2, "ORIGINAL", speeds);
+    if (nc_replayfile) {
+        fclose(nc_replayfile);
+        nc_replayfile = NULL;
+        nc_replayleft = 0;
+    }
+    nc_replayend = false;
+    if (fileName) {
+        FILE* f = fopen(fileName, "rb");
+        if (!f) {
+            return luaL_error(L, "cannot open file '%s': %s", fileName, strerror(errno));
+        }
+        char magic[sizeof(NC_RECORD_MAGIC) - 1];
+        if (   fread(magic, 1, sizeof(magic), f) != sizeof(magic) 
+            || memcmp(magic, NC_RECORD_MAGIC, sizeof(magic)) != 0) 
+        {
+            fclose(f);
+            return luaL_error(L, "file '%s' is not an input recording", fileName);
+        }
+        nc_replayfile = f;
+        nc_replaymax  = (speed == 1);
+        nc_replaydue  = getTime();
+        loadReplayChunk();
+    }
+    return 0;
+}
+
+static int Nocurses_setreader(lua_State* L)
+{
+    assureUnrestricted(L);
+
+    bool enable = lua_isnoneornil(L, 1) || lua_toboolean(L, 1);
+    if (enable && !nc_readeron) {
+        bool wasRaw = isRaw;
+        switchRaw(true);
+        if (!startReader()) {
+            switchRaw(wasRaw);
+            return luaL_error(L, "cannot start reader thread");
+        }
+        updateTstpHandler();
+    }
+    else if (!enable && nc_readeron) {
+        stopReader();
+    }
+    return 0;
+}
+
+static int Nocurses_catchsignal(lua_State* L)
+{
+    static const char* const names[] = { "INT", "TERM", NULL };
+    static const int         sigs[]  = { SIGINT, SIGTERM };
+    static const int         recs[]  = { NC_REC_INT, NC_REC_TERM };
+
+    assureUnrestricted(L);
+
+    int  i      = luaL_checkoption(L, 1, NULL, names);
+    bool enable = lua_isnoneornil(L, 2) || lua_toboolean(L, 2);
+    int  bit    = (1 << recs[i]);
+    if (enable && !(nc_sigcaught & bit)) {
+        signal(sigs[i], handleSignal);
+        nc_sigcaught |= bit;
+    }
+    else if (!enable && (nc_sigcaught & bit)) {
+        signal(sigs[i], SIG_DFL);
+        nc_sigcaught  &= ~bit;
+        nc_sigpending &= ~bit;
+    }
+    return 0;
+}
+
+static int Nocurses_watchfd(lua_State* L)
+{
+    assureUnrestricted(L);
+
+    int fd = luaL_checkinteger(L, 1);
+    if (fd < 0 || fd >= FD_SETSIZE) {
+        return luaL_argerror(L, 1, "invalid file descriptor");
+    }
+    int events = NC_WATCH_READ;
+    if (lua_isboolean(L, 2) && !lua_toboolean(L, 2)) {
+        events = 0;
+    }
+    else if (!lua_isnoneornil(L, 2)) {
+        const char* e = luaL_checkstring(L, 2);
+        events = 0;
+        for (; *e; ++e) {
+            if      (*e == 'r') events |= NC_WATCH_READ;
+            else if (*e == 'w') events |= NC_WATCH_WRITE;
+            else return luaL_argerror(L, 2, "invalid events, expected combination of 'r' and 'w'");
+        }
+    }
+    int i = 0;
+    while (i < nc_watchcnt && nc_watches[i].fd != fd) {
+        ++i;
+    }
+    if (events == 0) {
+        if (i < nc_watchcnt) {
+            nc_watches[i] = nc_watches[--nc_watchcnt];
+            nc_watchnext  = 0;
+        }
+        return 0;
+    }
+    if (i == nc_watchcnt) {
+        if (nc_watchcnt == nc_watchcap) {
+            int         newcap = nc_watchcap ? 2 * nc_watchcap : 8;
+            WatchEntry* newptr = (WatchEntry*) realloc(nc_watches, newcap * sizeof(WatchEntry));
+            if (!newptr) {
+                return luaL_error(L, "out of memory");
+            }
+            nc_watches  = newptr;
+            nc_watchcap = newcap;
+        }
+        nc_watches[i].fd = fd;
+        ++nc_watchcnt;
+    }
+    nc_watches[i].events = events;
+    return 0;
+}
+
+#define NC_TIMER_MAX 1e9  /* maximal interval in seconds, about 31 years */
+
+static int Nocurses_timer(lua_State* L)
+{
+    assureUnrestricted(L);
+
+    lua_Number interval = luaL_checknumber(L, 1);
+    luaL_argcheck(L, interval >= 0 && interval <= NC_TIMER_MAX, 1, "invalid interval");
+    lua_Number repeat = 0;
+    if (lua_isboolean(L, 2)) {
+        repeat = lua_toboolean(L, 2) ? interval : 0;
+    }
+    else if (!lua_isnoneornil(L, 2)) {
+        repeat = luaL_checknumber(L, 2);
+        luaL_argcheck(L, repeat >= 0 && repeat <= NC_TIMER_MAX, 2, "invalid repeat interval");
+    }
+    uint64_t repeatTicks = (uint64_t)(repeat * 1000);
+    if (repeat > 0 && repeatTicks == 0) {
+        repeatTicks = 1;
+    }
+    int i = 0;
+    while (i < nc_timertabcap && nc_timertab[i]) {
+        ++i;
+    }
+    if (i == nc_timertabcap) {
+        int       newcap = nc_timertabcap ? 2 * nc_timertabcap : 16;
+        NcTimer** newtab = (NcTimer**) realloc(nc_timertab, newcap * sizeof(NcTimer*));
+        if (!newtab) {
+            return luaL_error(L, "out of memory");
+        }
+        for (int j = nc_timertabcap; j < newcap; ++j) {
+            newtab[j] = NULL;
+        }
+        nc_timertab    = newtab;
+        nc_timertabcap = newcap;
+    }
+    NcTimer* t = (NcTimer*) calloc(1, sizeof(NcTimer));
+    if (!t) {
+        return luaL_error(L, "out of memory");
+    }
+    t->id          = ++nc_timerid;
+    t->index       = i;
+    t->interval    = repeatTicks;
+    t->node.slot   = -1;
+    nc_timertab[i] = t;
+
+    uint64_t now = getTicks();
+    timer_wheel_advance(&nc_timerwheel, now, handleExpiredTimer, &now);
+    timer_wheel_add(&nc_timerwheel, &t->node, now + (uint64_t)(interval * 1000));
+
+    lua_pushinteger(L, t->id);
+    return 1;
+}
+
+static int Nocurses_canceltimer(lua_State* L)
+{
+    assureUnrestricted(L);
+
+    lua_Integer id = luaL_checkinteger(L, 1);
+    for (int i = 0; i < nc_timertabcap; ++i) {
+        if (nc_timertab[i] && nc_timertab[i]->id == id) {
+            releaseTimer(nc_timertab[i]);
+            lua_pushboolean(L, true);
+            return 1;
+        }
+    }
+    lua_pushboolean(L, false);
+    return 1;
+}
+
+static const char* const NC_NOTIFIER_CLASS = "nocurses.notifier";
+
+/* the module table itself is a notifier that is reported without id */
+#define NC_MODULE_NOTIFIER ((notify_notifier*)NOCURSES_MODULE_NAME)
+
+static lua_Integer nc_notifierid = 0;
+
+static int Notifier_release(lua_State* L)
+{
+    notify_notifier** udata = (notify_notifier**) luaL_checkudata(L, 1, NC_NOTIFIER_CLASS);
+    if (*udata) {
+        releaseSource(*udata);
+        *udata = NULL;
+    }
+    return 0;
+}
+
+static int Notifier_id(lua_State* L)
+{
+    notify_notifier** udata = (notify_notifier**) luaL_checkudata(L, 1, NC_NOTIFIER_CLASS);
+    if (!*udata) {
+        return luaL_argerror(L, 1, "notifier is closed");
+    }
+    lua_pushinteger(L, (*udata)->id);
+    return 1;
+}
+
+static int Notifier_toString(lua_State* L)
+{
+    notify_notifier** udata = (notify_notifier**) luaL_checkudata(L, 1, NC_NOTIFIER_CLASS);
+    if (*udata) {
+        lua_pushfstring(L, "%s: %d", NC_NOTIFIER_CLASS, (int)(*udata)->id);
+    } else {
+        lua_pushfstring(L, "%s: closed", NC_NOTIFIER_CLASS);
+    }
+    return 1;
+}
+
+static int Nocurses_notifier(lua_State* L)
+{
+    assureUnrestricted(L);
+
+    lua_Integer id;
+    if (lua_isnoneornil(L, 1)) {
+        id = ++nc_notifierid;
+    } else {
+        id = luaL_checkinteger(L, 1);
+    }
+    notify_notifier** udata = (notify_notifier**) lua_newuserdata(L, sizeof(notify_notifier*));
+    *udata = NULL;
+    luaL_setmetatable(L, NC_NOTIFIER_CLASS);
+    
+    notify_notifier* n = (notify_notifier*) calloc(1, sizeof(notify_notifier));
+    if (!n) {
+        return luaL_error(L, "out of memory");
+    }
+    n->refcnt = 1;
+    n->id     = id;
+    *udata    = n;
+    return 1;
+}
+
+static notify_notifier* toNotifier(lua_State* L, int index)
+{
+    notify_notifier** udata = (notify_notifier**) luaL_testudata(L, index, NC_NOTIFIER_CLASS);
+    if (udata) {
+        return *udata;
+    }
+    notify_notifier* rslt = NULL;
+    if (lua_getmetatable(L, index))
+    {                                                      /* -> meta1 */
+        if (luaL_getmetatable(L, NOCURSES_MODULE_NAME)
+            != LUA_TNIL)                                   /* -> meta1, meta2 */
+        {
+            if (lua_rawequal(L, -1, -2)) {                 /* -> meta1, meta2 */
+                rslt = NC_MODULE_NOTIFIER;
+            }
+        }                                                  /* -> meta1, meta2 */
+        lua_pop(L, 2);                                     /* -> */
+    }                                                      /* -> */
+    return rslt;
+}
+
+static void retainNotifier(notify_notifier* n)
+{
+    if (n != NC_MODULE_NOTIFIER) {
+        retainSource(n);
+    }
+}
+
+static void releaseNotifier(notify_notifier* n)
+{
+    if (n != NC_MODULE_NOTIFIER) {
+        releaseSource(n);
+    }
+}
+
+static int notify(notify_notifier* n, notifier_error_handler eh, void* ehdata)
+{
+    if (n == NC_MODULE_NOTIFIER) {
+        sendNotify();
+    } else if (atomic_get(&initStage) == 1) {
+        notifySource(n);
+    } else {
+        return 1;  /* main state is closed */
+    }
+    return 0;
 }
 
+static const luaL_Reg NotifierMethods[] = 
+{
+    { "id",             Notifier_id      },
+    { "close",          Notifier_release },
+    { NULL,             NULL             } /* sentinel */
+};
+
+static struct notify_capi notify_capi_impl = 
+{
+    NOTIFY_CAPI_VERSION_MAJOR,
+    NOTIFY_CAPI_VERSION_MINOR,
+    NOTIFY_CAPI_VERSION_PATCH,
+    
+    NULL,
+    
+    toNotifier,
+    retainNotifier,
+    releaseNotifier,
+    notify
+};
+
+/* ============================================================================================ */
+
+#endif /* __unix__ */
+
 /* ============================================================================================ */
 
-static int Nocurses_setblink(lua_State* L)
+static const char* const NC_VTERM_CLASS = "nocurses.vterm";
+
+static const char* const vtermAttrs[] =
 {
-    luaL_checktype(L, 1, LUA_TBOOLEAN);
-    int flag = lua_toboolean(L, 1);
-    setblink(flag);
-    return 0;
+   "BOLD",      // SCREEN_ATTR_BOLD
+   "UNDERLINE", // SCREEN_ATTR_UNDERLINE
+   "BLINK",     // SCREEN_ATTR_BLINK
+   "INVERT",    // SCREEN_ATTR_INVERT
+   "DIM",       // VTERM_ATTR_DIM
+   "ITALIC",    // VTERM_ATTR_ITALIC
+    NULL
+};
+
+static const char* const vtermModes[] =
+{
+   "CURSOR",      // VTERM_MODE_CURSOR
+   "ALTBUFFER",   // VTERM_MODE_ALTBUFFER
+   "AUTOWRAP",    // VTERM_MODE_AUTOWRAP
+   "MOUSECLICK",  // VTERM_MODE_MOUSECLICK
+   "MOUSEDRAG",   // VTERM_MODE_MOUSEDRAG
+   "MOUSEMOTION", // VTERM_MODE_MOUSEMOTION
+   "MOUSESGR",    // VTERM_MODE_MOUSESGR
+   "PASTE",       // VTERM_MODE_PASTE
+    NULL
+};
+
+static VTerm* checkVTerm(lua_State* L, int arg)
+{
+    VTerm** vt = (VTerm**) luaL_checkudata(L, arg, NC_VTERM_CLASS);
+    if (!*vt) {
+        luaL_argerror(L, arg, "virtual terminal is closed");
+    }
+    return *vt;
 }
 
-/* ============================================================================================ */
+static void checkVTermSize(lua_State* L, int arg, int* width, int* height)
+{
+    lua_Integer w = luaL_checkinteger(L, arg);
+    lua_Integer h = luaL_checkinteger(L, arg + 1);
+    luaL_argcheck(L, w > 0 && w <= VTERM_MAX_SIZE, arg,     "invalid width");
+    luaL_argcheck(L, h > 0 && h <= VTERM_MAX_SIZE, arg + 1, "invalid height");
+    *width  = (int) w;
+    *height = (int) h;
+}
 
-static int Nocurses_setinvert(lua_State* L)
+static int Nocurses_newvterm(lua_State* L)
 {
-    luaL_checktype(L, 1, LUA_TBOOLEAN);
-    int flag = lua_toboolean(L, 1);
-    setinvert(flag);
+    assureUnrestricted(L);
+
+    int width, height;
+    checkVTermSize(L, 1, &width, &height);
+
+    lua_settop(L, 2);
+    VTerm** udata = (VTerm**) lua_newuserdata(L, sizeof(VTerm*));
+    *udata = NULL;
+    luaL_setmetatable(L, NC_VTERM_CLASS);
+
+    *udata = vterm_new(width, height);
+    if (!*udata) {
+        return luaL_error(L, "out of memory");
+    }
+    return 1;
+}
+
+static int VTerm_release(lua_State* L)
+{
+    VTerm** udata = (VTerm**) luaL_checkudata(L, 1, NC_VTERM_CLASS);
+    if (*udata) {
+        vterm_release(*udata);
+        *udata = NULL;
+    }
     return 0;
 }
 
-/* ============================================================================================ */
+static int VTerm_toString(lua_State* L)
+{
+    VTerm** udata = (VTerm**) luaL_checkudata(L, 1, NC_VTERM_CLASS);
+    if (*udata) {
+        lua_pushfstring(L, "%s: %p", NC_VTERM_CLASS, *udata);
+    } else {
+        lua_pushfstring(L, "%s: closed", NC_VTERM_CLASS);
+    }
+    return 1;
+}
 
-static int Nocurses_settitle(lua_State* L)
+static int VTerm_size(lua_State* L)
 {
-    const char* title = luaL_checkstring(L, 1);
-    settitle(title);
+    VTerm* vt = checkVTerm(L, 1);
+    lua_pushinteger(L, vt->cols);
+    lua_pushinteger(L, vt->rows);
+    return 2;
+}
+
+static int VTerm_resize(lua_State* L)
+{
+    VTerm* vt = checkVTerm(L, 1);
+    int    width, height;
+    checkVTermSize(L, 2, &width, &height);
+    if (!vterm_resize(vt, width, height)) {
+        return luaL_error(L, "out of memory");
+    }
     return 0;
 }
 
-/* ============================================================================================ */
+static int VTerm_reset(lua_State* L)
+{
+    VTerm* vt = checkVTerm(L, 1);
+    vterm_reset(vt);
+    return 0;
+}
 
-static const char* const shapes[] =
+static int VTerm_write(lua_State* L)
 {
-    "DEFAULT",
-    "BLOCK_BLINK",
-    "BLOCK",
-    "UNDERLINE_BLINK",
-    "UNDERLINE",
-    "BAR_BLINK",
-    "BAR",
-    NULL
-};
+    VTerm* vt = checkVTerm(L, 1);
+    int    n  = lua_gettop(L);
+    for (int i = 2; i <= n; ++i) {
+        size_t      len;
+        const char* s = luaL_checklstring(L, i, &len);
+        vterm_write(vt, s, len);
+    }
+    return 0;
+}
 
-static int Nocurses_setcurshape(lua_State* L)
+static int VTerm_input(lua_State* L)
 {
-    int shape = luaL_checkoption(L, 1, NULL, shapes);
-    setcurshape(shape);
+    VTerm* vt = checkVTerm(L, 1);
+    int    n  = lua_gettop(L);
+    for (int i = 2; i <= n; ++i) {
+        size_t      len;
+        const char* s = luaL_checklstring(L, i, &len);
+        if (!vterm_input(vt, s, len)) {
+            return luaL_error(L, "out of memory");
+        }
+    }
     return 0;
 }
 
-/* ============================================================================================ */
+static const ScreenCell* checkVTermCell(lua_State* L, VTerm* vt, int arg)
+{
+    int x = luaL_checkinteger(L, arg);
+    int y = luaL_checkinteger(L, arg + 1);
+    luaL_argcheck(L, x >= 1 && x <= vt->cols, arg,     "column out of range");
+    luaL_argcheck(L, y >= 1 && y <= vt->rows, arg + 1, "row out of range");
+    return vt->cells + (size_t)(y - 1) * vt->cols + (x - 1);
+}
 
-static int Nocurses_gettermsize(lua_State* L)
+static void pushVTermColor(lua_State* L, int color)
 {
-    struct termsize s = gettermsize();
-    lua_pushinteger(L, s.cols);
-    lua_pushinteger(L, s.rows);
-    return 2;
+    lua_pushstring(L, colors[(color < 8) ? color : 8]);
+}
+
+static int VTerm_cell(lua_State* L)
+{
+    VTerm*            vt = checkVTerm(L, 1);
+    const ScreenCell* c  = checkVTermCell(L, vt, 2);
+    int               n  = 3;
+    lua_settop(L, 3);
+    lua_pushlstring(L, c->text, c->len);
+    pushVTermColor(L, c->fg);
+    pushVTermColor(L, c->bg);
+    for (int i = 0; vtermAttrs[i]; ++i) {
+        if (c->attrs & (1 << i)) {
+            luaL_checkstack(L, 1, NULL);
+            lua_pushstring(L, vtermAttrs[i]);
+            n += 1;
+        }
+    }
+    return n;
+}
+
+static int VTerm_line(lua_State* L)
+{
+    VTerm* vt = checkVTerm(L, 1);
+    int    y  = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, y >= 1 && y <= vt->rows, 2, "row out of range");
+
+    const ScreenCell* row = vt->cells + (size_t)(y - 1) * vt->cols;
+    int               w   = vt->cols;
+    while (w > 0 && row[w - 1].len == 1 && row[w - 1].text[0] == ' ') {
+        w -= 1;  /* trailing blanks */
+    }
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    for (int x = 0; x < w; ++x) {
+        luaL_addlstring(&b, row[x].text, row[x].len);
+    }
+    luaL_pushresult(&b);
+    return 1;
+}
+
+static int VTerm_cursor(lua_State* L)
+{
+    VTerm* vt = checkVTerm(L, 1);
+    lua_pushinteger(L, vt->x + 1);
+    lua_pushinteger(L, vt->y + 1);
+    lua_pushboolean(L, vt->modes & VTERM_MODE_CURSOR);
+    lua_pushinteger(L, vt->curshape);
+    return 4;
+}
+
+static int VTerm_title(lua_State* L)
+{
+    VTerm* vt = checkVTerm(L, 1);
+    lua_pushlstring(L, vt->title, vt->titlelen);
+    return 1;
+}
+
+static int VTerm_mode(lua_State* L)
+{
+    VTerm* vt   = checkVTerm(L, 1);
+    int    mode = luaL_checkoption(L, 2, NULL, vtermModes);
+    lua_pushboolean(L, vt->modes & (1 << mode));
+    return 1;
+}
+
+static int VTerm_stats(lua_State* L)
+{
+    VTerm* vt = checkVTerm(L, 1);
+    lua_createtable(L, 0, 5);
+    lua_pushinteger(L, (lua_Integer) vt->bytes);
+    lua_setfield(L, -2, "bytes");
+    lua_pushinteger(L, (lua_Integer) vt->sequences);
+    lua_setfield(L, -2, "sequences");
+    lua_pushinteger(L, (lua_Integer) vt->text);
+    lua_setfield(L, -2, "text");
+    lua_pushinteger(L, (lua_Integer) vt->printed);
+    lua_setfield(L, -2, "cells");
+    lua_pushinteger(L, (lua_Integer) vt->unknown);
+    lua_setfield(L, -2, "unknown");
+    return 1;
+}
+
+static int VTerm_resetstats(lua_State* L)
+{
+    VTerm* vt = checkVTerm(L, 1);
+    vt->bytes     = 0;
+    vt->sequences = 0;
+    vt->text      = 0;
+    vt->printed   = 0;
+    vt->unknown   = 0;
+    return 0;
 }
 
+static const luaL_Reg VTermMethods[] = 
+{
+    { "size",           VTerm_size        },
+    { "resize",         VTerm_resize      },
+    { "reset",          VTerm_reset       },
+    { "write",          VTerm_write       },
+    { "input",          VTerm_input       },
+    { "cell",           VTerm_cell        },
+    { "line",           VTerm_line        },
+    { "cursor",         VTerm_cursor      },
+    { "title",          VTerm_title       },
+    { "mode",           VTerm_mode        },
+    { "stats",          VTerm_stats       },
+    { "resetstats",     VTerm_resetstats  },
+    { "close",          VTerm_release     },
+    { NULL,             NULL              } /* sentinel */
+};
+
 /* ============================================================================================ */
 
 #if defined(__unix__)
-static int nc_getch()
+
+static const char* const NC_TERMINAL_CLASS = "nocurses.terminal";
+
+/* updates the registered interest of an attached terminal after buffer changes */
+static void updateTerminal(Terminal* t)
 {
-    if (nc_readpos < nc_readlen) {
-        return nc_readbuffer[nc_readpos++];
+    TermObject* o = (TermObject*) t;
+    if (o->mux.index >= 0) {
+        term_mux_update(&nc_termmux, &o->mux);
     }
-    size_t len = read(fileno(stdin), nc_readbuffer, NC_READBUFLEN);
-    if (len > 0) {
-        nc_readpos = 1;
-        nc_readlen = len;
-        return nc_readbuffer[0];
+}
+
+static void detachTerminal(lua_State* L, TermObject* o)
+{
+    if (o->mux.index >= 0) {
+        term_mux_remove(&nc_termmux, &o->mux);
+        if (lua_rawgetp(L, LUA_REGISTRYINDEX, &nc_termmux) == LUA_TTABLE) {  /* -> table */
+            lua_pushnil(L);                                                  /* -> table, nil */
+            lua_rawsetp(L, -2, &o->mux);                                     /* -> table */
+        }
+        lua_pop(L, 1);                                                       /* -> */
     }
-    else {
-        clearInput();
-        return -1;
+}
+
+static Terminal* checkTerminal(lua_State* L, int arg)
+{
+    Terminal* t = (Terminal*) luaL_checkudata(L, arg, NC_TERMINAL_CLASS);
+    if (!t->inbuf) {
+        luaL_argerror(L, arg, "terminal is closed");
     }
+    return t;
 }
 
-static int nc_peekch(int offs)
+static double checkTimeout(lua_State* L, int arg)
 {
-    if (nc_readpos + offs < nc_readlen) {
-        return nc_readbuffer[nc_readpos + offs];
+    double timeout = -1;
+    if (!lua_isnoneornil(L, arg)) {
+        timeout = luaL_checknumber(L, arg);
+        if (timeout < 0){
+            timeout = 0;
+        }
     }
-    if (nc_readpos > 0 && nc_readpos < nc_readlen) {
-        memmove(nc_readbuffer, nc_readbuffer + nc_readpos, nc_readlen - nc_readpos);
-        nc_readlen -= nc_readpos;
-        nc_readpos = 0;
-    } else {
-        nc_readlen = 0;
-        nc_readpos = 0;
-    }   
-    if (nc_readlen < NC_READBUFLEN) {
-        size_t len = read(fileno(stdin), nc_readbuffer + nc_readlen, NC_READBUFLEN - nc_readlen);
-        if (len > 0) {
-            nc_readlen += len;
+    return timeout;
+}
+
+static int Nocurses_newterm(lua_State* L)
+{
+    assureUnrestricted(L);
+
+    VTerm** vt = (VTerm**) luaL_testudata(L, 1, NC_VTERM_CLASS);
+    if (vt) {
+        if (!*vt) {
+            return luaL_argerror(L, 1, "virtual terminal is closed");
         }
+        lua_settop(L, 1);
+        TermObject* o = (TermObject*) lua_newuserdata(L, sizeof(TermObject));
+        memset(o, 0, sizeof(TermObject));
+        o->mux.term  = &o->term;
+        o->mux.index = -1;
+        o->id        = ++nc_termids;
+        luaL_setmetatable(L, NC_TERMINAL_CLASS);
+        if (!terminal_init_vterm(&o->term, *vt)) {
+            return luaL_error(L, "out of memory");
+        }
+        return 1;
     }
-    if (nc_readpos + offs < nc_readlen) {
-        return nc_readbuffer[nc_readpos + offs];
+    int infd  = luaL_checkinteger(L, 1);
+    int outfd = luaL_optinteger(L, 2, infd);
+    if (infd < 0) {
+        return luaL_argerror(L, 1, "invalid file descriptor");
     }
-    else {
-        return -1;
+    if (outfd < 0) {
+        return luaL_argerror(L, 2, "invalid file descriptor");
     }
+    TermObject* o = (TermObject*) lua_newuserdata(L, sizeof(TermObject));
+    memset(o, 0, sizeof(TermObject));
+    o->mux.term  = &o->term;
+    o->mux.index = -1;
+    o->id        = ++nc_termids;
+    luaL_setmetatable(L, NC_TERMINAL_CLASS);
+    if (!terminal_init(&o->term, infd, outfd)) {
+        return luaL_error(L, "out of memory");
+    }
+    return 1;
 }
 
-static int nc_skipch(int skip)
+static int Terminal_release(lua_State* L)
 {
-    if (nc_readpos + skip <= nc_readlen) {
-        nc_readpos += skip;
-        return skip;
+    TermObject* o = (TermObject*) luaL_checkudata(L, 1, NC_TERMINAL_CLASS);
+    detachTerminal(L, o);
+    for (ScreenRender* r = nc_renderfirst; r; r = r->pendingnext) {
+        if (r->term      == o) r->term      = NULL;
+        if (r->againterm == o) r->againterm = NULL;
     }
-    if (nc_readpos > 0 && nc_readpos < nc_readlen) {
-        memmove(nc_readbuffer, nc_readbuffer + nc_readpos, nc_readlen - nc_readpos);
-        nc_readlen -= nc_readpos;
-        nc_readpos = 0;
-    } else {
-        nc_readlen = 0;
-        nc_readpos = 0;
-    }   
-    if (nc_readlen < NC_READBUFLEN) {
-        size_t len = read(fileno(stdin), nc_readbuffer + nc_readlen, NC_READBUFLEN - nc_readlen);
-        if (len > 0) {
-            nc_readlen += len;
-        }
+    if (o->term.inbuf) {
+        terminal_done(&o->term);
     }
-    if (nc_readpos + skip <= nc_readlen) {
-        nc_readpos += skip;
-        return skip;
+    return 0;
+}
+
+static int Terminal_attach(lua_State* L)
+{
+    Terminal*   t    = checkTerminal(L, 1);
+    TermObject* o    = (TermObject*) t;
+    bool        flag = lua_isnoneornil(L, 2) ? true : lua_toboolean(L, 2);
+    assureUnrestricted(L);
+
+    if (!flag) {
+        detachTerminal(L, o);
+        return 0;
     }
-    else {
-        skip = nc_readlen - nc_readpos;
-        nc_readpos = 0;
-        nc_readlen = 0;
-        return skip;
+    if (o->mux.index >= 0) {
+        return 0;
+    }
+    if (t->vterm) {
+        return luaL_error(L, "cannot attach terminal: no file descriptors");
+    }
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, &nc_termmux) != LUA_TTABLE) {  /* -> nil */
+        lua_pop(L, 1);                                                   /* -> */
+        lua_newtable(L);                                                 /* -> table */
+        lua_pushvalue(L, -1);                                            /* -> table, table */
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &nc_termmux);                  /* -> table */
+    }
+    if (!term_mux_add(&nc_termmux, &o->mux)) {
+        return luaL_error(L, "cannot attach terminal: %s", strerror(errno));
     }
+    lua_pushvalue(L, 1);                                                 /* -> table, term */
+    lua_rawsetp(L, -2, &o->mux);                                         /* -> table */
+    return 0;
 }
-#endif
-
-/* ============================================================================================ */
 
-static int assureUnrestricted(lua_State* L)
+static int Terminal_toString(lua_State* L)
 {
-    bool restricted = true;
-    if (lua_rawgetp(L, LUA_REGISTRYINDEX, NOCURSES_MODULE_NAME) == LUA_TUSERDATA) { // -> nocurses
-        if (lua_touserdata(L, -1) == udata) {                                       // -> nocurses
-            restricted = false;
-        }
-    }
-    lua_pop(L, 1); // -> 
-    if (restricted) {
-        return luaL_error(L, "function must be called from main thread");
+    Terminal* t = (Terminal*) luaL_checkudata(L, 1, NC_TERMINAL_CLASS);
+    if (t->inbuf) {
+        lua_pushfstring(L, "%s: %d", NC_TERMINAL_CLASS, t->infd);
+    } else {
+        lua_pushfstring(L, "%s: closed", NC_TERMINAL_CLASS);
     }
-    else {
-        return 0;
+    return 1;
+}
+
+static int Terminal_fd(lua_State* L)
+{
+    Terminal* t = checkTerminal(L, 1);
+    lua_pushinteger(L, t->infd);
+    lua_pushinteger(L, t->outfd);
+    return 2;
+}
+
+static int Terminal_setraw(lua_State* L)
+{
+    Terminal* t    = checkTerminal(L, 1);
+    bool      flag = lua_isnoneornil(L, 2) ? true : lua_toboolean(L, 2);
+    if (!terminal_setraw(t, flag)) {
+        return luaL_error(L, "cannot set raw mode: %s", strerror(errno));
     }
+    return 0;
 }
 
-/* ============================================================================================ */
+static int Terminal_israw(lua_State* L)
+{
+    Terminal* t = checkTerminal(L, 1);
+    lua_pushboolean(L, t->raw);
+    return 1;
+}
 
-static int Nocurses_getch(lua_State* L)
+static int Terminal_getsize(lua_State* L)
 {
-    fflush(stdout);
+    Terminal* t = checkTerminal(L, 1);
+    int cols, rows;
+    if (terminal_getsize(t, &cols, &rows)) {
+        lua_pushinteger(L, cols);
+        lua_pushinteger(L, rows);
+        return 2;
+    }
+    lua_pushnil(L);
+    return 1;
+}
 
-    assureUnrestricted(L);
+static int Terminal_setsize(lua_State* L)
+{
+    Terminal* t = checkTerminal(L, 1);
+    t->cols = luaL_checkinteger(L, 2);
+    t->rows = luaL_checkinteger(L, 3);
+    return 0;
+}
 
-    double timeout = -1;
-    if (!lua_isnoneornil(L, 1)) {
-        timeout = luaL_checknumber(L, 1);
-        if (timeout < 0){
-            timeout = 0;
+static int Terminal_write(lua_State* L)
+{
+    Terminal* t = checkTerminal(L, 1);
+    int       n = lua_gettop(L);
+    for (int i = 2; i <= n; ++i) {
+        size_t      len;
+        const char* s = luaL_checklstring(L, i, &len);
+        if (!terminal_write(t, s, len)) {
+            return luaL_error(L, "out of memory");
         }
     }
-#if defined(__unix__)
-    bool hasInp = hasInput() || waitForInput(timeout);
-    if (hasInp) {
-        int c = nc_getch();
-        if (c >= 0) {
-            lua_pushinteger(L, c);
-        } else {
-            lua_pushnil(L);
-        }
-    } else {
-        lua_pushnil(L);
+    return 0;
+}
+
+static int Terminal_flush(lua_State* L)
+{
+    Terminal* t  = checkTerminal(L, 1);
+    int       rc = terminal_flush(t);
+    updateTerminal(t);
+    if (rc < 0) {
+        return luaL_error(L, "cannot write terminal output: %s", strerror(errno));
     }
-#else
-    lua_pushinteger(L, getch());
-#endif
+    lua_pushboolean(L, rc > 0);
     return 1;
 }
 
-/* ============================================================================================ */
+#define TERMINAL_SEQ(name, seq) \
+    static int Terminal_##name(lua_State* L) \
+    { \
+        Terminal* t = checkTerminal(L, 1); \
+        terminal_printf(t, "%s", SEQ(seq)); \
+        return 0; \
+    }
+
+TERMINAL_SEQ(clrscr,     clear_screen)
+TERMINAL_SEQ(clrline,    clear_line)
+TERMINAL_SEQ(clrtoeol,   clear_to_eol)
+TERMINAL_SEQ(clrtoeos,   clear_to_eos)
+TERMINAL_SEQ(resetcolors, reset_attrs)
+TERMINAL_SEQ(showcursor, show_cur)
+TERMINAL_SEQ(hidecursor, hide_cur)
+
+#undef TERMINAL_SEQ
+
+static int Terminal_gotoxy(lua_State* L)
+{
+    Terminal* t = checkTerminal(L, 1);
+    int       x = luaL_checkinteger(L, 2);
+    int       y = luaL_checkinteger(L, 3);
+    terminal_printf(t, SEQ(goto_row_col), y, x);
+    return 0;
+}
+
+static int Terminal_setfontcolor(lua_State* L)
+{
+    Terminal* t     = checkTerminal(L, 1);
+    int       color = luaL_checkoption(L, 2, NULL, colors);
+    terminal_printf(t, SEQ(set_foregrd_color), (color == 8) ? 9 : color);
+    return 0;
+}
 
-static int Nocurses_peekch(lua_State* L)
+static int Terminal_setbgrcolor(lua_State* L)
 {
-    fflush(stdout);
+    Terminal* t     = checkTerminal(L, 1);
+    int       color = luaL_checkoption(L, 2, NULL, colors);
+    terminal_printf(t, SEQ(set_backgrd_color), (color == 8) ? 9 : color);
+    return 0;
+}
 
-    assureUnrestricted(L);
+static int Terminal_settitle(lua_State* L)
+{
+    Terminal*   t     = checkTerminal(L, 1);
+    const char* title = luaL_checkstring(L, 2);
+    terminal_printf(t, SEQ(set_title), title);
+    return 0;
+}
 
-    int offs = 0;
-    if (!lua_isnoneornil(L, 1)) {
-        offs = luaL_checkinteger(L, 1) - 1;
-        if (offs < 0 || offs >= NC_READBUFLEN) {
-            return luaL_argerror(L, 1, "invalid offset");
+/* pushes nil or nil and "closed" if no input is available */
+static int pushNoTerminalInput(lua_State* L, int rc)
+{
+    lua_pushnil(L);
+    if (rc == -1) {
+        lua_pushliteral(L, "closed");
+        return 2;
+    }
+    return 1;
+}
+
+static int Terminal_getch(lua_State* L)
+{
+    Terminal* t       = checkTerminal(L, 1);
+    double    timeout = checkTimeout(L, 2);
+    if (t->inpos == t->inlen) {
+        int rc = terminal_fill(t, timeout);
+        if (rc <= 0) {
+            return pushNoTerminalInput(L, rc);
         }
     }
-    double timeout = 0;
-    if (!lua_isnoneornil(L, 2)) {
-        timeout = luaL_checknumber(L, 2);
-        if (timeout < 0){
-            timeout = 0;
+    lua_pushinteger(L, t->inbuf[t->inpos]);
+    terminal_consume(t, 1);
+    updateTerminal(t);
+    return 1;
+}
+
+static bool waitTerminalInput(InputQueue* q, size_t avail, uint64_t deadline)
+{
+    Terminal* t = (Terminal*) q->ctx;
+    while (t->inlen - t->inpos <= avail) {
+        uint64_t now = getTicks();
+        if (now >= deadline || terminal_fill(t, (double)(deadline - now) / 1000) < 0) {
+            return false;  /* also if a virtual terminal has no more input */
         }
     }
-#if defined(__unix__)
-    bool hasInp = hasInputAt(offs) || waitForInput(timeout);
-    if (hasInp) {
-        int c = nc_peekch(offs);
-        if (c >= 0) {
-            lua_pushinteger(L, c);
-        } else {
-            lua_pushnil(L);
+    return true;
+}
+
+static int Terminal_getseq(lua_State* L)
+{
+    Terminal* t        = checkTerminal(L, 1);
+    double    timeout  = checkTimeout(L, 2);
+    double    timeout2 = luaL_optnumber(L, 3, 0.050);
+    if (t->inpos == t->inlen) {
+        int rc = terminal_fill(t, timeout);
+        if (rc <= 0) {
+            return pushNoTerminalInput(L, rc);
         }
-    } else {
-        lua_pushnil(L);
     }
-#else
-    lua_pushnil(L);
-#endif
+    InputQueue q = { &t->inbuf, &t->inpos, &t->inlen, t, waitTerminalInput };
+    size_t     pos;
+    int        len = takeSequence(&q, getTicks() + (uint64_t)(timeout2 * 1000), &pos);
+    lua_pushlstring(L, (const char*)t->inbuf + pos, len);
+    terminal_consume(t, 0);  /* resets the buffer if all input was taken */
+    updateTerminal(t);
     return 1;
 }
 
+static const luaL_Reg TerminalMethods[] = 
+{
+    { "fd",             Terminal_fd           },
+    { "setraw",         Terminal_setraw       },
+    { "israw",          Terminal_israw        },
+    { "getsize",        Terminal_getsize      },
+    { "setsize",        Terminal_setsize      },
+    { "write",          Terminal_write        },
+    { "flush",          Terminal_flush        },
+    { "clrscr",         Terminal_clrscr       },
+    { "clrline",        Terminal_clrline      },
+    { "clrtoeol",       Terminal_clrtoeol     },
+    { "clrtoeos",       Terminal_clrtoeos     },
+    { "gotoxy",         Terminal_gotoxy       },
+    { "setfontcolor",   Terminal_setfontcolor },
+    { "setbgrcolor",    Terminal_setbgrcolor  },
+    { "resetcolors",    Terminal_resetcolors  },
+    { "showcursor",     Terminal_showcursor   },
+    { "hidecursor",     Terminal_hidecursor   },
+    { "settitle",       Terminal_settitle     },
+    { "getch",          Terminal_getch        },
+    { "getseq",         Terminal_getseq       },
+    { "attach",         Terminal_attach       },
+    { "close",          Terminal_release      },
+    { NULL,             NULL                  } /* sentinel */
+};
+
+#endif /* __unix__ */
+
 /* ============================================================================================ */
 
-static int Nocurses_skipch(lua_State* L)
-{
-    fflush(stdout);
+static const char* const NC_SCREEN_CLASS = "nocurses.screen";
 
-    assureUnrestricted(L);
+static const char* const screenAttrs[] =
+{
+   "BOLD",      // SCREEN_ATTR_BOLD
+   "UNDERLINE", // SCREEN_ATTR_UNDERLINE
+   "BLINK",     // SCREEN_ATTR_BLINK
+   "INVERT",    // SCREEN_ATTR_INVERT
+    NULL
+};
 
-    int skip = 1;
-    if (!lua_isnoneornil(L, 1)) {
-        skip = luaL_checkinteger(L, 1) ;
-    }
-    if (skip <= 0) {
-        lua_pushinteger(L, 0);
-        return 1;
-    }
-#if defined(__unix__)
-    bool hasInp = hasInputAt(skip - 1) || waitForInput(0 /* timeout */);
-    if (hasInp) {
-        int skipped = nc_skipch(skip);
-        lua_pushinteger(L, skipped);
-    } else {
-        lua_pushinteger(L, 0);
+static ScreenBuffer* checkScreen(lua_State* L, int arg)
+{
+    ScreenBuffer** sb = (ScreenBuffer**) luaL_checkudata(L, arg, NC_SCREEN_CLASS);
+    if (!*sb) {
+        luaL_argerror(L, arg, "screen is closed");
     }
-#else
-    lua_pushnil(L);
-#endif
-    return 1;
+    return *sb;
 }
 
-/* ============================================================================================ */
+static int checkScreenColor(lua_State* L, int arg)
+{
+    int color = luaL_checkoption(L, arg, "DEFAULT", colors);
+    return (color == 8) ? SCREEN_COLOR_DEFAULT : color;
+}
 
-static int Nocurses_clrline(lua_State* L)
+static int checkScreenAttrs(lua_State* L, int firstArg)
 {
-    clrline();
-    return 0;
+    int attrs = 0;
+    for (int i = firstArg; i <= lua_gettop(L); ++i) {
+        attrs |= 1 << luaL_checkoption(L, i, NULL, screenAttrs);
+    }
+    return attrs;
 }
 
-/* ============================================================================================ */
+/* pushes a screen object without buffer, the buffer is set via the returned pointer */
+static ScreenBuffer** pushScreen(lua_State* L)
+{
+    ScreenBuffer** udata = (ScreenBuffer**) lua_newuserdata(L, sizeof(ScreenBuffer*));
+    *udata = NULL;
+    luaL_setmetatable(L, NC_SCREEN_CLASS);
+    return udata;
+}
 
-static int Nocurses_clrtoeol(lua_State* L)
+static int Nocurses_newscreen(lua_State* L)
 {
-    printf(SEQ(clear_to_eol));
-    return 0;
+    assureUnrestricted(L);
+
+    lua_Integer width  = luaL_checkinteger(L, 1);
+    lua_Integer height = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, width  > 0 && width  <= SCREEN_MAX_SIZE, 1, "invalid width");
+    luaL_argcheck(L, height > 0 && height <= SCREEN_MAX_SIZE, 2, "invalid height");
+
+    lua_settop(L, 2);
+    ScreenBuffer** udata = pushScreen(L);
+    *udata = screen_buffer_new((int) width, (int) height);
+    if (!*udata) {
+        return luaL_error(L, "out of memory");
+    }
+    return 1;
 }
 
-/* ============================================================================================ */
+static int Nocurses_screen(lua_State* L)
+{
+    int id = luaL_checkinteger(L, 1);
+    lua_settop(L, 1);
+    ScreenBuffer** udata = pushScreen(L);
+    *udata = screen_buffer_find(id);
+    if (!*udata) {
+        lua_pushnil(L);
+    }
+    return 1;
+}
 
-static int Nocurses_clrtoeos(lua_State* L)
+static int Screen_release(lua_State* L)
 {
-    printf(SEQ(clear_to_eos));
+    ScreenBuffer** udata = (ScreenBuffer**) luaL_checkudata(L, 1, NC_SCREEN_CLASS);
+    if (*udata) {
+        screen_buffer_release(*udata);
+        *udata = NULL;
+    }
     return 0;
 }
 
-/* ============================================================================================ */
+static int Screen_toString(lua_State* L)
+{
+    ScreenBuffer** udata = (ScreenBuffer**) luaL_checkudata(L, 1, NC_SCREEN_CLASS);
+    if (*udata) {
+        lua_pushfstring(L, "%s: %d", NC_SCREEN_CLASS, (*udata)->id);
+    } else {
+        lua_pushfstring(L, "%s: closed", NC_SCREEN_CLASS);
+    }
+    return 1;
+}
 
-static int Nocurses_resetcolors(lua_State* L)
+static int Screen_id(lua_State* L)
 {
-    resetcolors();
-    return 0;
+    ScreenBuffer* sb = checkScreen(L, 1);
+    lua_pushinteger(L, sb->id);
+    return 1;
 }
 
-/* ============================================================================================ */
+static int Screen_size(lua_State* L)
+{
+    ScreenBuffer* sb = checkScreen(L, 1);
+    lua_pushinteger(L, sb->width);
+    lua_pushinteger(L, sb->height);
+    return 2;
+}
 
-static int Nocurses_showcursor(lua_State* L)
+static int Screen_put(lua_State* L)
 {
-    assureUnrestricted(L);
-    
-    nc_hidecur = false;
-    showcursor();
+    ScreenBuffer* sb   = checkScreen(L, 1);
+    int           x    = luaL_checkinteger(L, 2);
+    int           y    = luaL_checkinteger(L, 3);
+    size_t        len;
+    const char*   text = luaL_checklstring(L, 4, &len);
+    int           fg   = checkScreenColor(L, 5);
+    int           bg   = checkScreenColor(L, 6);
+    int           attrs = checkScreenAttrs(L, 7);
+
+    lua_pushinteger(L, screen_buffer_put(sb, x - 1, y - 1, text, len, fg, bg, attrs));
+    return 1;
+}
 
+static int Screen_fill(lua_State* L)
+{
+    ScreenBuffer* sb = checkScreen(L, 1);
+    int           x  = luaL_optinteger(L, 2, 1);
+    int           y  = luaL_optinteger(L, 3, 1);
+    int           w  = luaL_optinteger(L, 4, sb->width);
+    int           h  = luaL_optinteger(L, 5, sb->height);
+    int           bg = checkScreenColor(L, 6);
+
+    screen_buffer_fill(sb, x - 1, y - 1, w, h, SCREEN_COLOR_DEFAULT, bg, 0);
     return 0;
 }
 
-/* ============================================================================================ */
-
-static int Nocurses_hidecursor(lua_State* L)
+static bool sameCellAttrs(const ScreenCell* a, const ScreenCell* b)
 {
-    assureUnrestricted(L);
+    return a->fg == b->fg && a->bg == b->bg && a->attrs == b->attrs;
+}
 
-    nc_hidecur = true;
-    hidecursor();
-    return 0;
+static bool sameCell(const ScreenCell* a, const ScreenCell* b)
+{
+    return sameCellAttrs(a, b) && a->len == b->len && memcmp(a->text, b->text, a->len) == 0;
 }
 
-/* ============================================================================================ */
+static void printCellAttrs(RenderJob* out, const ScreenCell* c)
+{
+    char  buf[64];
+    char* p = buf;
+    p += sprintf(p, "%s%s", SEQ(attrs_begin), SEQ(attr_reset));
+    p += sprintf(p, "%s3%d%s4%d", SEQ(attrs_next), c->fg, SEQ(attrs_next), c->bg);
+    if (c->attrs & SCREEN_ATTR_BOLD)      p += sprintf(p, "%s%s", SEQ(attrs_next), SEQ(attr_bold));
+    if (c->attrs & SCREEN_ATTR_UNDERLINE) p += sprintf(p, "%s%s", SEQ(attrs_next), SEQ(attr_underline));
+    if (c->attrs & SCREEN_ATTR_BLINK)     p += sprintf(p, "%s%s", SEQ(attrs_next), SEQ(attr_blink));
+    if (c->attrs & SCREEN_ATTR_INVERT)    p += sprintf(p, "%s%s", SEQ(attrs_next), SEQ(attr_inverse));
+    p += sprintf(p, "%s", SEQ(attrs_end));
+    render_job_write(out, buf, p - buf);
+}
 
-static int Nocurses_setraw(lua_State* L)
+/* 
+ * Appends the output for the cells that were changed since the last flush and 
+ * returns the number of changed cells. Runs in the main thread or in a render
+ * worker thread. The sequences are counted in stats if not NULL.
+ */
+static int encodeScreen(ScreenBuffer* sb, int ox, int oy, RenderJob* out, NcStats* stats)
 {
-    assureUnrestricted(L);
-    
-    bool raw = true;
-    
-    if (!lua_isnoneornil(L, 1)) {
-        raw = lua_toboolean(L, 1);
+    ScreenCell* row = (ScreenCell*) malloc(sb->width * sizeof(ScreenCell));
+    if (!row) {
+        out->failed = true;
+        return 0;
     }
-    
-    setRaw(raw);
-
-    return 0;
+    int        cnt   = 0;
+    int        curx  = -1;
+    int        cury  = -1;
+    ScreenCell attrs;
+    for (int y = 0; y < sb->height; ++y) {
+        if (!screen_buffer_read_row(sb, y, row)) {
+            continue;
+        }
+        ScreenCell* shown = sb->shown + (size_t)y * sb->width;
+        for (int x = 0; x < sb->width; ++x) {
+            const ScreenCell* c = row + x;
+            if (sameCell(c, shown + x)) {
+                continue;
+            }
+            if (x != curx || y != cury) {
+                size_t len = out->len;
+                render_job_printf(out, SEQ(goto_row_col), oy + y, ox + x);
+                if (stats) {
+                    stats->seqcount[SEQ_IDX_goto_row_col] += 1;
+                    stats->seqbytes[SEQ_IDX_goto_row_col] += out->len - len;
+                }
+            }
+            if (cnt == 0 || !sameCellAttrs(c, &attrs)) {
+                size_t len = out->len;
+                printCellAttrs(out, c);
+                attrs = *c;
+                if (stats) {
+                    stats->seqcount[SEQ_IDX_attrs_begin] += 1;
+                    stats->seqbytes[SEQ_IDX_attrs_begin] += out->len - len;
+                }
+            }
+            render_job_write(out, c->text, c->len);
+            shown[x] = *c;
+            /* the display width of other clusters is unknown, e.g. wide characters
+             * or emoji, the next cell is positioned absolutely */
+            bool ascii = c->len == 1 && (unsigned char)c->text[0] >= 0x20 
+                                     && (unsigned char)c->text[0] <  0x7f;
+            curx = ascii ? x + 1 : -1;
+            cury = y;
+            cnt += 1;
+        }
+    }
+    free(row);
+    return cnt;
 }
 
-/* ============================================================================================ */
-
-static int Nocurses_israw(lua_State* L)
+static void checkNotRendering(lua_State* L, ScreenBuffer* sb)
 {
-    assureUnrestricted(L);
-    
-    lua_pushboolean(L, isRaw);
-    
-    return 1;
+    if (sb->render) {
+        luaL_error(L, "screen is being rendered");
+    }
 }
 
-/* ============================================================================================ */
+/* 
+ * The last shown content of a screen buffer is kept for one target only, stdout
+ * has the id 0. Another target is accepted after screen:invalidate().
+ */
+static void checkTarget(lua_State* L, ScreenBuffer* sb, int target)
+{
+    if (sb->target >= 0 && sb->target != target) {
+        luaL_error(L, "screen is shown on another terminal");
+    }
+    sb->target = target;
+}
 
-static int Nocurses_isatty(lua_State* L)
+static int Screen_flush(lua_State* L)
 {
+    ScreenBuffer* sb  = checkScreen(L, 1);
+    int           ox  = luaL_optinteger(L, 2, 1);
+    int           oy  = luaL_optinteger(L, 3, 1);
+    NcStats*      stats = &nc_stats;  /* only output to stdout is counted */
+#if defined(__unix__)
+    Terminal*     out = NULL;
+    if (!lua_isnoneornil(L, 4)) {
+        out   = checkTerminal(L, 4);
+        stats = NULL;
+    }
+#endif
     assureUnrestricted(L);
-    
-    luaL_Stream* stream = (luaL_Stream*) luaL_checkudata(L, 1, LUA_FILEHANDLE);
-    
-    if (stream->f) {
-        lua_pushboolean(L, isatty(fileno(stream->f)));
-    } else {
-        lua_pushboolean(L, false);
+    checkNotRendering(L, sb);
+#if defined(__unix__)
+    checkTarget(L, sb, out ? ((TermObject*)out)->id : 0);
+#else
+    checkTarget(L, sb, 0);
+#endif
+    TRACE_CALL();
+
+    RenderJob job;
+    render_job_init(&job, NULL);
+    int cnt = encodeScreen(sb, ox, oy, &job, stats);
+    if (job.failed) {
+        render_job_done(&job);
+        screen_buffer_invalidate(sb);
+        return luaL_error(L, "out of memory");
     }
-    
+    if (cnt > 0) {
+    #if defined(__unix__)
+        if (out) {
+            terminal_write(out, job.buf, job.len);
+            terminal_write(out, SEQ(reset_attrs), strlen(SEQ(reset_attrs)));
+        } else
+    #endif
+        {
+            fwrite(job.buf, 1, job.len, stdout);
+            nc_stats.outbytes += job.len;
+            nc_outpending     += job.len;
+            traceOutput(job.buf, job.len);
+            restoreAttrs();
+            flushOutput();
+        }
+    }
+    render_job_done(&job);
+    lua_pushinteger(L, cnt);
     return 1;
 }
 
-/* ============================================================================================ */
-
-#if defined(__unix__)    
-
-static int Nocurses_awake(lua_State* L)
+static int Screen_invalidate(lua_State* L)
 {
-    sendAwake();
+    ScreenBuffer* sb = checkScreen(L, 1);
+    assureUnrestricted(L);
+    checkNotRendering(L, sb);
+    screen_buffer_invalidate(sb);
     return 0;
 }
 
-static notify_notifier* toNotifier(lua_State* L, int index)
+#if defined(__unix__)
+
+static void renderScreen(RenderJob* job)
 {
-    notify_notifier* rslt = NULL;
-    if (lua_getmetatable(L, index))
-    {                                                      /* -> meta1 */
-        if (luaL_getmetatable(L, NOCURSES_MODULE_NAME)
-            != LUA_TNIL)                                   /* -> meta1, meta2 */
-        {
-            if (lua_rawequal(L, -1, -2)) {                 /* -> meta1, meta2 */
-                rslt = (notify_notifier*)NOCURSES_MODULE_NAME;
-            }
-        }                                                  /* -> meta1, meta2 */
-        lua_pop(L, 2);                                     /* -> */
-    }                                                      /* -> */
-    return rslt;
+    ScreenRender* r = (ScreenRender*) job;
+    r->cnt = encodeScreen(r->sb, r->ox, r->oy, job, NULL);
 }
 
-static void retainNotifier(notify_notifier* n)
-{}
+static int defaultRenderThreads()
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? (int) n : 1;
+}
 
-static void releaseNotifier(notify_notifier* n)
-{}
+static void startRenderPool()
+{
+    if (nc_renderthreads < 0) {
+        if (!render_pool_start(defaultRenderThreads(), wakeMain)) {
+            render_pool_start(0, wakeMain);  /* renders are done by the main thread */
+        }
+        nc_renderthreads = render_pool_threads();
+    }
+}
 
-static int notify(notify_notifier* n, notifier_error_handler eh, void* ehdata)
+static int Screen_render(lua_State* L)
 {
-    sendAwake();
-    return 0;
+    ScreenBuffer* sb = checkScreen(L, 1);
+    TermObject*   o  = (TermObject*) checkTerminal(L, 2);
+    int           ox = luaL_optinteger(L, 3, 1);
+    int           oy = luaL_optinteger(L, 4, 1);
+    assureUnrestricted(L);
+    checkTarget(L, sb, o->id);
+
+    ScreenRender* r = (ScreenRender*) sb->render;
+    if (r) {
+        r->again     = true;
+        r->againterm = o;
+        r->againx    = ox;
+        r->againy    = oy;
+        lua_pushboolean(L, false);
+        return 1;
+    }
+    r = (ScreenRender*) calloc(1, sizeof(ScreenRender));
+    if (!r) {
+        return luaL_error(L, "out of memory");
+    }
+    startRenderPool();
+    render_job_init(&r->job, renderScreen);
+    screen_buffer_retain(sb);
+    r->sb      = sb;
+    r->id      = sb->id;
+    r->term    = o;
+    r->ox      = ox;
+    r->oy      = oy;
+    sb->render = r;
+    submitRender(r);
+    lua_pushboolean(L, true);
+    return 1;
 }
 
-static struct notify_capi notify_capi_impl = 
+static int Nocurses_renderthreads(lua_State* L)
 {
-    NOTIFY_CAPI_VERSION_MAJOR,
-    NOTIFY_CAPI_VERSION_MINOR,
-    NOTIFY_CAPI_VERSION_PATCH,
-    
-    NULL,
-    
-    toNotifier,
-    retainNotifier,
-    releaseNotifier,
-    notify
-};
+    assureUnrestricted(L);
+    if (lua_isnoneornil(L, 1)) {
+        lua_pushinteger(L, (nc_renderthreads >= 0) ? nc_renderthreads : defaultRenderThreads());
+        return 1;
+    }
+    int n = luaL_checkinteger(L, 1);
+    luaL_argcheck(L, n >= 0, 1, "non-negative integer expected");
+    if (!render_pool_start(n, wakeMain)) {
+        int err = errno;
+        render_pool_start(0, wakeMain);
+        nc_renderthreads = 0;
+        return luaL_error(L, "cannot start render threads: %s", strerror(err));
+    }
+    nc_renderthreads = n;
+    lua_pushinteger(L, n);
+    return 1;
+}
 
 #endif /* __unix__ */
 
+static const luaL_Reg ScreenMethods[] = 
+{
+    { "id",             Screen_id         },
+    { "size",           Screen_size       },
+    { "put",            Screen_put        },
+    { "fill",           Screen_fill       },
+    { "flush",          Screen_flush      },
+    { "invalidate",     Screen_invalidate },
+#if defined(__unix__)
+    { "render",         Screen_render     },
+#endif
+    { "close",          Screen_release    },
+    { NULL,             NULL              } /* sentinel */
+};
+
 /* ============================================================================================ */
 
 static const luaL_Reg RestrictedModuleFunctions[] = 
 {
 #if defined(__unix__)    
-    { "awake",          Nocurses_awake },
+    { "awake",          Nocurses_awake  },
+    { "post",           Nocurses_post   },
 #endif
-    { NULL,             NULL           } /* sentinel */
+    { "now",            Nocurses_now    },
+    { "screen",         Nocurses_screen },
+    { NULL,             NULL            } /* sentinel */
 };
 
 static const luaL_Reg ModuleFunctions[] = 
@@ -793,6 +4769,15 @@ static const luaL_Reg ModuleFunctions[] =
     { "getch",          Nocurses_getch        },
     { "peekch",         Nocurses_peekch       },
     { "skipch",         Nocurses_skipch       },
+    { "setmouse",       Nocurses_setmouse     },
+    { "decodemouse",    Nocurses_decodemouse  },
+    { "getseq",         Nocurses_getseq       },
+    { "setpaste",       Nocurses_setpaste     },
+    { "getpaste",       Nocurses_getpaste     },
+    { "setkeyboard",    Nocurses_setkeyboard  },
+    { "decodekey",      Nocurses_decodekey    },
+    { "setcoalesce",    Nocurses_setcoalesce  },
+    { "skiprepeat",     Nocurses_skiprepeat   },
     { "clrline",        Nocurses_clrline      },
     { "clrtoeol",       Nocurses_clrtoeol     },
     { "clrtoeos",       Nocurses_clrtoeos     },
@@ -801,10 +4786,32 @@ static const luaL_Reg ModuleFunctions[] =
     { "hidecursor",     Nocurses_hidecursor   },
 #if defined(__unix__)    
     { "awake",          Nocurses_awake        },
+    { "post",           Nocurses_post         },
+    { "notifier",       Nocurses_notifier     },
+    { "newterm",        Nocurses_newterm      },
+    { "renderthreads",  Nocurses_renderthreads },
+    { "poll",           Nocurses_poll         },
+    { "setyield",       Nocurses_setyield     },
+    { "setreader",      Nocurses_setreader    },
+    { "record",         Nocurses_record       },
+    { "replay",         Nocurses_replay       },
+    { "catchsignal",    Nocurses_catchsignal  },
+    { "watchfd",        Nocurses_watchfd      },
+    { "timer",          Nocurses_timer        },
+    { "canceltimer",    Nocurses_canceltimer  },
 #endif
+    { "now",            Nocurses_now          },
+    { "inputtime",      Nocurses_inputtime    },
     { "setraw",         Nocurses_setraw       },
     { "israw",          Nocurses_israw        },
     { "isatty",         Nocurses_isatty       },
+    { "stats",          Nocurses_stats        },
+    { "resetstats",     Nocurses_resetstats   },
+    { "trace",          Nocurses_trace        },
+    { "dumptrace",      Nocurses_dumptrace    },
+    { "newscreen",      Nocurses_newscreen    },
+    { "screen",         Nocurses_screen       },
+    { "newvterm",       Nocurses_newvterm     },
     { NULL,             NULL           } /* sentinel */
 };
 
@@ -839,6 +4846,7 @@ DLL_PUBLIC int luaopen_nocurses(lua_State* L)
         restricted = false;
     #if defined(__unix__)
         initAwake();
+        timer_wheel_init(&nc_timerwheel, getTicks());
     #endif
         udata = lua_newuserdata(L, 1);                              /* -> sentinel */
         lua_newtable(L);                                            /* -> sentinel, metatable */
@@ -884,6 +4892,52 @@ DLL_PUBLIC int luaopen_nocurses(lua_State* L)
     
     lua_checkstack(L, LUA_MINSTACK);
 
+#if defined(__unix__)    
+    if (!restricted) {
+        luaL_newmetatable(L, NC_NOTIFIER_CLASS);           /* -> meta */
+        notify_set_capi(L, -1, &notify_capi_impl);         /* -> meta */
+        lua_pushcfunction(L, Notifier_release);            /* -> meta, func */
+        lua_setfield(L, -2, "__gc");                       /* -> meta */
+        lua_pushcfunction(L, Notifier_toString);           /* -> meta, func */
+        lua_setfield(L, -2, "__tostring");                 /* -> meta */
+        lua_newtable(L);                                   /* -> meta, methods */
+        luaL_setfuncs(L, NotifierMethods, 0);              /* -> meta, methods */
+        lua_setfield(L, -2, "__index");                    /* -> meta */
+        lua_pop(L, 1);                                     /* -> */
+
+        luaL_newmetatable(L, NC_TERMINAL_CLASS);           /* -> meta */
+        lua_pushcfunction(L, Terminal_release);            /* -> meta, func */
+        lua_setfield(L, -2, "__gc");                       /* -> meta */
+        lua_pushcfunction(L, Terminal_toString);           /* -> meta, func */
+        lua_setfield(L, -2, "__tostring");                 /* -> meta */
+        lua_newtable(L);                                   /* -> meta, methods */
+        luaL_setfuncs(L, TerminalMethods, 0);              /* -> meta, methods */
+        lua_setfield(L, -2, "__index");                    /* -> meta */
+        lua_pop(L, 1);                                     /* -> */
+    }
+#endif
+    luaL_newmetatable(L, NC_SCREEN_CLASS);             /* -> meta */
+    lua_pushcfunction(L, Screen_release);              /* -> meta, func */
+    lua_setfield(L, -2, "__gc");                       /* -> meta */
+    lua_pushcfunction(L, Screen_toString);             /* -> meta, func */
+    lua_setfield(L, -2, "__tostring");                 /* -> meta */
+    lua_newtable(L);                                   /* -> meta, methods */
+    luaL_setfuncs(L, ScreenMethods, 0);                /* -> meta, methods */
+    lua_setfield(L, -2, "__index");                    /* -> meta */
+    lua_pop(L, 1);                                     /* -> */
+
+    if (!restricted) {
+        luaL_newmetatable(L, NC_VTERM_CLASS);              /* -> meta */
+        lua_pushcfunction(L, VTerm_release);               /* -> meta, func */
+        lua_setfield(L, -2, "__gc");                       /* -> meta */
+        lua_pushcfunction(L, VTerm_toString);              /* -> meta, func */
+        lua_setfield(L, -2, "__tostring");                 /* -> meta */
+        lua_newtable(L);                                   /* -> meta, methods */
+        luaL_setfuncs(L, VTermMethods, 0);                 /* -> meta, methods */
+        lua_setfield(L, -2, "__index");                    /* -> meta */
+        lua_pop(L, 1);                                     /* -> */
+    }
+
     luaL_newmetatable(L, NOCURSES_MODULE_NAME);        /* -> meta */
 #if defined(__unix__)    
     notify_set_capi(L, -1, &notify_capi_impl);         /* -> meta */
@@ -102,6 +102,25 @@
     \
     SEQ_DEF( request_cur_pos,                  ESC"[6n"               ) \
     SEQ_DEF( response_cur_pos,                 ESC"%[(%d+);(%d+)R"    ) \
+    \
+    SEQ_DEF( mouse_click_on,                   ESC"[?1000h"           ) \
+    SEQ_DEF( mouse_click_off,                  ESC"[?1000l"           ) \
+    SEQ_DEF( mouse_drag_on,                    ESC"[?1002h"           ) \
+    SEQ_DEF( mouse_drag_off,                   ESC"[?1002l"           ) \
+    SEQ_DEF( mouse_motion_on,                  ESC"[?1003h"           ) \
+    SEQ_DEF( mouse_motion_off,                 ESC"[?1003l"           ) \
+    SEQ_DEF( mouse_sgr_on,                     ESC"[?1006h"           ) \
+    SEQ_DEF( mouse_sgr_off,                    ESC"[?1006l"           ) \
+    SEQ_DEF( mouse_sgr_report,                 ESC"[<"                ) \
+    \
+    SEQ_DEF( paste_on,                         ESC"[?2004h"           ) \
+    SEQ_DEF( paste_off,                        ESC"[?2004l"           ) \
+    SEQ_DEF( paste_begin,                      ESC"[200~"             ) \
+    SEQ_DEF( paste_end,                        ESC"[201~"             ) \
+    \
+    SEQ_DEF( keyboard_push,                    ESC"[>%du"             ) \
+    SEQ_DEF( keyboard_set,                     ESC"[=%du"             ) \
+    SEQ_DEF( keyboard_pop,                     ESC"[<u"               ) \
     
     
 
@@ -148,18 +167,25 @@ static int bg_color     = 9,
          font_invert    = 0;
 
 
+/* primitives that the module writes via counted sequences instead */
+#if defined(__GNUC__)
+# define NC_UNUSED __attribute__((unused))
+#else
+# define NC_UNUSED
+#endif
+
 #if 0
 static void wait(){
     while (fgetc(stdin) != '\n');
 }
 #endif
 
-static void clrscr(){
+static NC_UNUSED void clrscr(){
     printf(SEQ(clear_screen));
 }
 
 
-static void gotoxy(int x, int y){
+static NC_UNUSED void gotoxy(int x, int y){
     printf(SEQ(goto_row_col), y, x);
 }
 
@@ -234,11 +260,11 @@ static void setinvert(int status){
     }
 }
 
-static void settitle(char const* title) {
+static NC_UNUSED void settitle(char const* title) {
     printf(SEQ(set_title), title);
 }
 
-static void setcurshape(int shape){
+static NC_UNUSED void setcurshape(int shape){
     // vt520/xterm-style; linux terminal uses ESC[?1;2;3c, not implemented
     printf(SEQ(set_cur_shape), shape);
 }
@@ -314,11 +340,11 @@ static int getch(){
 }
 
 
-static void clrline(){
+static NC_UNUSED void clrline(){
     printf(SEQ(clear_line));
 }
 
-static void resetcolors(){
+static NC_UNUSED void resetcolors(){
 //    printf(ESC"001b");
     printf(SEQ(reset_attrs));
     bg_color       = 9;
@@ -329,10 +355,10 @@ static void resetcolors(){
     font_invert    = 0;
 }
 
-static void showcursor(){
+static NC_UNUSED void showcursor(){
     printf(SEQ(show_cur));
 }
 
-static void hidecursor(){
+static NC_UNUSED void hidecursor(){
     printf(SEQ(hide_cur));
 }
@@ -2,41 +2,23 @@ local byte     = string.byte
 local char     = string.char
 
 local nocurses         = require("nocurses")
-local getch            = nocurses.getch
-local peekch           = nocurses.peekch
-local skipch           = nocurses.skipch
+local getseq           = nocurses.getseq
+local decodemouse      = nocurses.decodemouse
+local getpaste         = nocurses.getpaste
+local decodekey        = nocurses.decodekey
+local skiprepeat       = nocurses.skiprepeat
+local mouse_sgr_report = nocurses.seq.mouse_sgr_report
+local paste_begin      = nocurses.seq.paste_begin
 local response_cur_pos = nocurses.seq.response_cur_pos
 
-if not getch then
+if not getseq then
     error("nocurses.getkey must be invoked from main thread")
 end
 
 local BYTE_ESC = 0x1B
 local BYTE_LBR = byte("[")
-local BYTE_TLD = byte("~")
-
-local BYTE_A   = byte("A")
-local BYTE_B   = byte("B")
-local BYTE_C   = byte("C")
-local BYTE_D   = byte("D")
-local BYTE_F   = byte("F")
-local BYTE_H   = byte("H")
 local BYTE_O   = byte("O")
-local BYTE_P   = byte("P")
-local BYTE_Q   = byte("Q")
-local BYTE_R   = byte("R")
-local BYTE_S   = byte("S")
-
-local BYTE_0   = byte("0")
-local BYTE_1   = byte("1")
-local BYTE_2   = byte("2")
-local BYTE_3   = byte("3")
-local BYTE_4   = byte("4")
-local BYTE_5   = byte("5")
-local BYTE_6   = byte("6")
-local BYTE_7   = byte("7")
-local BYTE_8   = byte("8")
-local BYTE_9   = byte("9")
+local BYTE_A   = byte("A")
 
 local BYTE_LF  = 0x0A
 local BYTE_TAB = 0x09
@@ -44,156 +26,137 @@ local BYTE_BS1 = 0x7F
 local BYTE_BS2 = 0x08
 local BYTE_SPC = 0x20
 
-local function parseCSI(rslt, c3, timeout2)
-    while true do
-        if not c3 then
-            return rslt
-        end
-        rslt = rslt..char(c3)
-        if c3 >= 0x40 then
-            return rslt
-        end
-        c3 = getch(timeout2)
-    end
+local CSI_KEYS = {
+    ["\27[A"]    = "Up",
+    ["\27[B"]    = "Down",
+    ["\27[C"]    = "Right",
+    ["\27[D"]    = "Left",
+
+    ["\27[F"]    = "End",
+    ["\27[H"]    = "Home",
+
+    ["\27[2~"]   = "Insert",
+    ["\27[3~"]   = "Delete",
+    ["\27[5~"]   = "PageUp",
+    ["\27[6~"]   = "PageDown",
+
+    ["\27[11~"]  = "F1",
+    ["\27[12~"]  = "F2",
+    ["\27[13~"]  = "F3",
+    ["\27[14~"]  = "F4",
+
+    ["\27[15~"]  = "F5",
+    ["\27[17~"]  = "F6",
+    ["\27[18~"]  = "F7",
+    ["\27[19~"]  = "F8",
+
+    ["\27[20~"]  = "F9",
+    ["\27[21~"]  = "F10",
+    ["\27[23~"]  = "F11",
+    ["\27[24~"]  = "F12",
+
+    ["\27[1;2A"] = "Shift+Up",
+    ["\27[1;2B"] = "Shift+Down",
+    ["\27[1;2C"] = "Shift+Right",
+    ["\27[1;2D"] = "Shift+Left",
+
+    ["\27[1;5A"] = "Ctrl+Up",
+    ["\27[1;5B"] = "Ctrl+Down",
+    ["\27[1;5C"] = "Ctrl+Right",
+    ["\27[1;5D"] = "Ctrl+Left",
+
+    ["\27[1;3A"] = "Alt+Up",
+    ["\27[1;3B"] = "Alt+Down",
+    ["\27[1;3C"] = "Alt+Right",
+    ["\27[1;3D"] = "Alt+Left",
+
+    ["\27[2;5~"] = "Ctrl+Insert",
+    ["\27[3;5~"] = "Ctrl+Delete",
+    ["\27[1;5H"] = "Ctrl+Home",
+    ["\27[1;5F"] = "Ctrl+End",
+    ["\27[5;5~"] = "Ctrl+PageUp",
+    ["\27[6;5~"] = "Ctrl+PageDown",
+
+    ["\27[2;3~"] = "Alt+Insert",
+    ["\27[3;3~"] = "Alt+Delete",
+    ["\27[1;3H"] = "Alt+Home",
+    ["\27[1;3F"] = "Alt+End",
+    ["\27[5;3~"] = "Alt+PageUp",
+    ["\27[6;3~"] = "Alt+PageDown",
+}
+
+local SS3_KEYS = {
+    [byte("P")] = "F1",
+    [byte("Q")] = "F2",
+    [byte("R")] = "F3",
+    [byte("S")] = "F4",
+}
+
+-- returns named key with event type and repeat count, directly following
+-- repetitions are skipped if coalescing is enabled (see nocurses.setcoalesce)
+local function named(name, bytes, event)
+    return name, bytes, event or "press", skiprepeat(bytes)
 end
 
-local function readUtf8Char(c1, timeout2)
-    local rslt = char(c1)
-    if c1 < BYTE_SPC then
-        return "Ctrl+"..char(BYTE_A + c1 - 1), rslt
-    elseif c1 >= 0xC0 then -- could be start of utf8 character
-        local i = 0
-        while true do
-            local cn = peekch(i + 1, timeout2)
-            if cn then
-                if cn >= 0x80 and cn <= 0xBF then
-                    rslt = rslt..char(cn) -- utf8 follow-up byte
-                    i = i + 1
-                else
-                    skipch(i)
-                    return false, rslt
-                end
-            else
-                skipch(i)
-                return false, rslt
-            end
+local function getCSIKey(seq)
+    local name = CSI_KEYS[seq]
+    if name then
+        return named(name, seq)
+    end
+    if seq:sub(1, #mouse_sgr_report) == mouse_sgr_report then
+        local x, y, button, action, mods = decodemouse(seq)
+        if x then
+            return "Mouse", seq, x, y, button, action, mods
         end
-    else
-        return false, rslt
+        return false, seq
+    end
+    if seq == paste_begin then
+        local text, complete = getpaste()
+        return "Paste", text, complete
     end
+    local y, x = seq:match(response_cur_pos)
+    if y then
+        return "CursorXY", seq, tonumber(x), tonumber(y)
+    end
+    -- keyboard enhancement protocol and other modifier combinations
+    local name, event, text = decodekey(seq)
+    if name then
+        return named(name, seq, event)
+    elseif name == false then
+        return false, text, event
+    end
+    return false, seq
 end
 
 local function getkey(timeout, timeout2)
-    timeout2 = timeout2 or 0.050
-    local c1 = getch(timeout)
-    if c1 then
-        if c1 == BYTE_ESC then
-            local c2 = peekch(1, timeout2)
-            if c2 then
-                if c2 == BYTE_LBR then
-                    skipch()
-                    local c3 = getch(timeout2)
-                    if c3 then
-                        local parsed = parseCSI(char(c1, c2), c3, timeout2)
-                        
-                            if parsed == "\27[A" then return "Up",    parsed
-                        elseif parsed == "\27[B" then return "Down",  parsed
-                        elseif parsed == "\27[C" then return "Right", parsed
-                        elseif parsed == "\27[D" then return "Left",  parsed
-
-                        elseif parsed == "\27[F" then return "End",  parsed
-                        elseif parsed == "\27[H" then return "Home", parsed
-                        
-                        elseif parsed == "\27[2~" then return "Insert",   parsed
-                        elseif parsed == "\27[3~" then return "Delete",   parsed
-                        elseif parsed == "\27[5~" then return "PageUp",   parsed
-                        elseif parsed == "\27[6~" then return "PageDown", parsed
-
-                        elseif parsed == "\27[11~" then return "F1", parsed
-                        elseif parsed == "\27[12~" then return "F2", parsed
-                        elseif parsed == "\27[13~" then return "F3", parsed
-                        elseif parsed == "\27[14~" then return "F4", parsed
-
-                        elseif parsed == "\27[15~" then return "F5", parsed
-                        elseif parsed == "\27[17~" then return "F6", parsed
-                        elseif parsed == "\27[18~" then return "F7", parsed
-                        elseif parsed == "\27[19~" then return "F8", parsed
-
-                        elseif parsed == "\27[20~" then return "F9", parsed
-                        elseif parsed == "\27[21~" then return "F10", parsed
-                        elseif parsed == "\27[23~" then return "F11", parsed
-                        elseif parsed == "\27[24~" then return "F12", parsed
-
-                        elseif parsed == "\27[1;2A" then return "Shift+Up", parsed
-                        elseif parsed == "\27[1;2B" then return "Shift+Down", parsed
-                        elseif parsed == "\27[1;2C" then return "Shift+Right", parsed
-                        elseif parsed == "\27[1;2D" then return "Shift+Left", parsed
-
-                        elseif parsed == "\27[1;5A" then return "Ctrl+Up", parsed
-                        elseif parsed == "\27[1;5B" then return "Ctrl+Down", parsed
-                        elseif parsed == "\27[1;5C" then return "Ctrl+Right", parsed
-                        elseif parsed == "\27[1;5D" then return "Ctrl+Left", parsed
-                        
-                        elseif parsed == "\27[1;3A" then return "Alt+Up", parsed
-                        elseif parsed == "\27[1;3B" then return "Alt+Down", parsed
-                        elseif parsed == "\27[1;3C" then return "Alt+Right", parsed
-                        elseif parsed == "\27[1;3D" then return "Alt+Left", parsed
-                        
-                        elseif parsed == "\27[2;5~" then return "Ctrl+Insert", parsed
-                        elseif parsed == "\27[3;5~" then return "Ctrl+Delete", parsed
-                        elseif parsed == "\27[1;5H" then return "Ctrl+Home", parsed
-                        elseif parsed == "\27[1;5F" then return "Ctrl+End", parsed
-                        elseif parsed == "\27[5;5~" then return "Ctrl+PageUp", parsed
-                        elseif parsed == "\27[6;5~" then return "Ctrl+PageDown", parsed
-                        
-                        elseif parsed == "\27[2;3~" then return "Alt+Insert", parsed
-                        elseif parsed == "\27[3;3~" then return "Alt+Delete", parsed
-                        elseif parsed == "\27[1;3H" then return "Alt+Home", parsed
-                        elseif parsed == "\27[1;3F" then return "Alt+End", parsed
-                        elseif parsed == "\27[5;3~" then return "Alt+PageUp", parsed
-                        elseif parsed == "\27[6;3~" then return "Alt+PageDown", parsed
-                        else
-                            local y, x = parsed:match(response_cur_pos)
-                            if y then
-                                return "CursorXY", parsed, tonumber(x), tonumber(y)
-                            else
-                                return false, parsed
-                            end
-                        end
-                    end
-                    return false, char(c1, c2)
-                elseif c2 == BYTE_O then
-                    skipch()
-                    local c3 = getch(timeout2)
-                    if c3 then
-                            if c3 == BYTE_P then return "F1", char(c1, c2, c3)
-                        elseif c3 == BYTE_Q then return "F2", char(c1, c2, c3)
-                        elseif c3 == BYTE_R then return "F3", char(c1, c2, c3)
-                        elseif c3 == BYTE_S then return "F4", char(c1, c2, c3)
-                        end
-                        return false, char(c1, c2, c3)
-                    end
-                    return false, char(c1, c2)
-                end
-                skipch()
-                local _, parsed = readUtf8Char(c2, timeout2)
-                if parsed == " " then
-                    return "Alt+Space", char(c1)..parsed
-                else
-                    return "Alt+"..parsed
-                end
-            else
-                return "Escape", char(c1)
+    local seq, w1, w2, w3 = getseq(timeout, timeout2)
+    if not seq then
+        return nil, w1, w2, w3
+    end
+    local c1, c2, c3 = byte(seq, 1, 3)
+    if c1 == BYTE_ESC then
+        if not c2 then
+            return "Escape", seq, "press", 1
+        elseif c2 == BYTE_LBR then
+            return getCSIKey(seq)
+        elseif c2 == BYTE_O then
+            local name = c3 and SS3_KEYS[c3]
+            if name then
+                return named(name, seq)
             end
-        elseif c1 == BYTE_LF  then return "Enter", char(c1)
-        elseif c1 == BYTE_TAB then return "Tab", char(c1)
-        elseif c1 == BYTE_BS1
-            or c1 == BYTE_BS2 then return "Backspace", char(c1)
+            return false, seq
+        elseif c2 == BYTE_SPC then
+            return named("Alt+Space", seq)
         else
-            return readUtf8Char(c1, timeout2)
+            return named("Alt+"..seq:sub(2), seq)
         end
+    elseif c1 == BYTE_LF  then return named("Enter", seq)
+    elseif c1 == BYTE_TAB then return named("Tab", seq)
+    elseif c1 == BYTE_BS1
+        or c1 == BYTE_BS2 then return named("Backspace", seq)
+    elseif c1 < BYTE_SPC  then return named("Ctrl+"..char(BYTE_A + c1 - 1), seq)
     else
-        return nil
+        return false, seq
     end
 end
 
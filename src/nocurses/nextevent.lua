@@ -0,0 +1,37 @@
+local nocurses    = require("nocurses")
+local getkey      = nocurses.getkey
+local gettermsize = nocurses.gettermsize
+
+if not nocurses.getseq then
+    error("nocurses.nextevent must be invoked from main thread")
+end
+
+-- converts the wakeup reason of getch/getseq/getkey into an event
+local function wakeupEvent(reason, v1, v2)
+    if reason == "signal" then
+        if v1 == "WINCH" then
+            local w, h = gettermsize()
+            return "resize", w, h
+        end
+        return "signal", v1
+    elseif reason then
+        return reason, v1, v2 -- "awake", "notify", "message", "timer", "rendered", "term", "fd" or "replay"
+    end
+    return nil -- timeout
+end
+
+local function nextevent(timeout, timeout2)
+    local name, a1, a2, a3, a4, a5, a6 = getkey(timeout, timeout2)
+    if name == "Mouse" then
+        return "mouse", a2, a3, a4, a5, a6
+    elseif name == "Paste" then
+        return "paste", a1, a2
+    elseif name then
+        return "key", name, a1, a2, a3, a4
+    elseif name == false then
+        return "text", a1
+    end
+    return wakeupEvent(a1, a2, a3)
+end
+
+return nextevent
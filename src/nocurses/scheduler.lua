@@ -0,0 +1,83 @@
+local nocurses = require("nocurses")
+local poll     = nocurses.poll
+local now      = nocurses.now
+local setyield = nocurses.setyield
+
+local create   = coroutine.create
+local resume   = coroutine.resume
+local status   = coroutine.status
+local unpack   = table.unpack or unpack
+
+if not poll then
+    error("nocurses.scheduler must be invoked from main thread")
+end
+
+local WAIT = "nocurses.wait" -- yielded by getch/getseq if no input is available
+
+local tasks = {}
+
+local function spawn(f, ...)
+    tasks[#tasks + 1] = { co = create(f), args = { n = select("#", ...), ... } }
+end
+
+-- resumes task, a task is waiting if suspended inside getch/getseq
+local function step(task)
+    local args = task.args or { n = 0 }
+    task.args  = nil
+    local ok, what, timeout = resume(task.co, unpack(args, 1, args.n))
+    if not ok then
+        setyield(false)
+        error(what, 0)
+    end
+    if status(task.co) == "dead" then
+        task.dead = true
+    elseif what == WAIT then
+        task.waiting  = true
+        task.deadline = timeout and (now() + timeout)
+    else
+        task.waiting  = false -- plain coroutine.yield(), runs again in the next round
+    end
+end
+
+-- runs all spawned tasks until they have finished, all waiting tasks are 
+-- multiplexed by one native wait via nocurses.poll()
+local function run()
+    setyield(true)
+    local polled = false
+    while #tasks > 0 do
+        local t       = now()
+        local current = { unpack(tasks) }
+        for _, task in ipairs(current) do
+            if polled or not task.waiting or (task.deadline and task.deadline <= t) then
+                step(task)
+            end
+        end
+        local timeout = nil
+        local n = 0
+        for _, task in ipairs(tasks) do
+            if not task.dead then
+                n = n + 1
+                tasks[n] = task
+                if not task.waiting then
+                    timeout = 0
+                elseif task.deadline then
+                    local remaining = task.deadline - now()
+                    if remaining < 0 then remaining = 0 end
+                    if not timeout or remaining < timeout then
+                        timeout = remaining
+                    end
+                end
+            end
+        end
+        for i = #tasks, n + 1, -1 do
+            tasks[i] = nil
+        end
+        polled = (n > 0) and poll(timeout)
+    end
+    setyield(false)
+end
+
+return {
+    spawn = spawn,
+    run   = run
+}
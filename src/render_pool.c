@@ -0,0 +1,218 @@
+#ifndef _WIN32
+# include <pthread.h>
+# include <signal.h>
+#endif
+#include <stdarg.h>
+
+#include "render_pool.h"
+
+/* -------------------------------------------------------------------------------------------- */
+
+#define INITIAL_CAP 4096
+
+void render_job_init(RenderJob* job, RenderFunc func)
+{
+    memset(job, 0, sizeof(RenderJob));
+    job->func = func;
+}
+
+void render_job_done(RenderJob* job)
+{
+    free(job->buf);
+    job->buf = NULL;
+    job->len = 0;
+    job->cap = 0;
+}
+
+static bool reserve(RenderJob* job, size_t len)
+{
+    if (job->len + len > job->cap) {
+        size_t newcap = job->cap ? 2 * job->cap : INITIAL_CAP;
+        while (newcap < job->len + len) {
+            newcap *= 2;
+        }
+        char* newbuf = (char*) realloc(job->buf, newcap);
+        if (!newbuf) {
+            job->failed = true;
+            return false;
+        }
+        job->buf = newbuf;
+        job->cap = newcap;
+    }
+    return true;
+}
+
+void render_job_write(RenderJob* job, const void* data, size_t len)
+{
+    if (reserve(job, len)) {
+        memcpy(job->buf + job->len, data, len);
+        job->len += len;
+    }
+}
+
+void render_job_printf(RenderJob* job, const char* fmt, ...)
+{
+    char    buf[64];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n < 0) {
+        return;
+    }
+    if ((size_t)n < sizeof(buf)) {
+        render_job_write(job, buf, n);
+    }
+    else if (reserve(job, (size_t)n + 1)) {
+        /* formatted again directly into the job buffer */
+        va_start(args, fmt);
+        vsnprintf(job->buf + job->len, (size_t)n + 1, fmt, args);
+        va_end(args);
+        job->len += n;
+    }
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+#ifndef _WIN32
+
+static pthread_mutex_t queueMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  queueCond  = PTHREAD_COND_INITIALIZER;
+static RenderJob*      queueFirst = NULL;    /* guarded by queueMutex */
+static RenderJob*      queueLast  = NULL;
+static bool            stopping   = false;
+
+static pthread_t*      threads    = NULL;    /* main thread only */
+static int             nthreads   = 0;
+static void          (*notifyFunc)(void) = NULL;
+
+static AtomicPtr       doneStack  = NULL;    /* finished jobs, newest first */
+
+static void finishJob(RenderJob* job)
+{
+    job->func(job);
+    RenderJob* head;
+    do {
+        head      = (RenderJob*) atomic_get_ptr(&doneStack);
+        job->next = head;
+    } while (!atomic_set_ptr_if_equal(&doneStack, head, job));
+    if (notifyFunc) {
+        notifyFunc();
+    }
+}
+
+static void* workerMain(void* arg)
+{
+    (void)arg;
+    while (true) {
+        pthread_mutex_lock(&queueMutex);
+        while (!queueFirst && !stopping) {
+            pthread_cond_wait(&queueCond, &queueMutex);
+        }
+        RenderJob* job = queueFirst;
+        if (job) {
+            queueFirst = job->next;
+            if (!queueFirst) {
+                queueLast = NULL;
+            }
+        }
+        pthread_mutex_unlock(&queueMutex);
+        if (!job) {
+            break;  /* stopping and queue is empty */
+        }
+        finishJob(job);
+    }
+    return NULL;
+}
+
+bool render_pool_start(int n, void (*notify)(void))
+{
+    render_pool_stop();
+    notifyFunc = notify;
+    if (n <= 0) {
+        return true;
+    }
+    threads = (pthread_t*) malloc(n * sizeof(pthread_t));
+    if (!threads) {
+        errno = ENOMEM;
+        return false;
+    }
+    /* signals are handled by the main thread only */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int rc = 0;
+    while (nthreads < n && (rc = pthread_create(threads + nthreads, NULL, workerMain, NULL)) == 0) {
+        nthreads += 1;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0) {
+        render_pool_stop();
+        errno = rc;
+        return false;
+    }
+    return true;
+}
+
+void render_pool_stop(void)
+{
+    if (nthreads > 0) {
+        pthread_mutex_lock(&queueMutex);
+        stopping = true;
+        pthread_cond_broadcast(&queueCond);
+        pthread_mutex_unlock(&queueMutex);
+        for (int i = 0; i < nthreads; ++i) {
+            pthread_join(threads[i], NULL);
+        }
+        stopping = false;
+    }
+    free(threads);
+    threads  = NULL;
+    nthreads = 0;
+}
+
+int render_pool_threads(void)
+{
+    return nthreads;
+}
+
+void render_pool_submit(RenderJob* job)
+{
+    job->next   = NULL;
+    job->len    = 0;
+    job->failed = false;
+    if (nthreads == 0) {
+        finishJob(job);
+        return;
+    }
+    pthread_mutex_lock(&queueMutex);
+    if (queueLast) {
+        queueLast->next = job;
+    } else {
+        queueFirst = job;
+    }
+    queueLast = job;
+    pthread_cond_signal(&queueCond);
+    pthread_mutex_unlock(&queueMutex);
+}
+
+RenderJob* render_pool_take(void)
+{
+    RenderJob* head;
+    do {
+        head = (RenderJob*) atomic_get_ptr(&doneStack);
+    } while (head && !atomic_set_ptr_if_equal(&doneStack, head, NULL));
+
+    RenderJob* reversed = NULL;
+    while (head) {
+        RenderJob* next = head->next;
+        head->next = reversed;
+        reversed   = head;
+        head       = next;
+    }
+    return reversed;
+}
+
+#endif /* !_WIN32 */
+
+/* -------------------------------------------------------------------------------------------- */
@@ -0,0 +1,97 @@
+#ifndef NOCURSES_RENDER_POOL_H
+#define NOCURSES_RENDER_POOL_H
+
+#include "util.h"
+#include "async_util.h"
+
+/* -------------------------------------------------------------------------------------------- */
+
+/*
+ * Pool of native worker threads that produce output bytes for the main thread,
+ * e.g. the escape sequences for the changed cells of a screen buffer. Jobs are
+ * submitted by the main thread and run in submission order by the next free
+ * worker. Finished jobs are pushed onto a lock-free stack and the notify function
+ * is called, the main thread takes all finished jobs at once.
+ *
+ * Jobs are usually embedded as first member in a larger struct that holds the
+ * input of the job function.
+ */
+
+typedef struct RenderJob RenderJob;
+
+typedef void (*RenderFunc)(RenderJob* job);
+
+struct RenderJob
+{
+    RenderJob*  next;      /* link in the queues of the pool */
+    RenderFunc  func;      /* invoked by a worker thread */
+    char*       buf;       /* output of the job function */
+    size_t      len;
+    size_t      cap;
+    bool        failed;    /* out of memory while writing the output */
+};
+
+/* -------------------------------------------------------------------------------------------- */
+
+#define render_job_init     nocurses_render_job_init
+#define render_job_done     nocurses_render_job_done
+#define render_job_write    nocurses_render_job_write
+#define render_job_printf   nocurses_render_job_printf
+#define render_pool_start   nocurses_render_pool_start
+#define render_pool_stop    nocurses_render_pool_stop
+#define render_pool_threads nocurses_render_pool_threads
+#define render_pool_submit  nocurses_render_pool_submit
+#define render_pool_take    nocurses_render_pool_take
+
+void render_job_init(RenderJob* job, RenderFunc func);
+
+/**
+ * Frees the output buffer.
+ */
+void render_job_done(RenderJob* job);
+
+/**
+ * Appends bytes to the output buffer. Sets the failed flag if out of memory.
+ */
+void render_job_write(RenderJob* job, const void* data, size_t len);
+
+void render_job_printf(RenderJob* job, const char* fmt, ...);
+
+#ifndef _WIN32
+
+/**
+ * Starts the given number of worker threads, running workers are stopped before.
+ * If nthreads is 0, submitted jobs are run by the main thread. The notify function
+ * is called from the thread that finished a job. Returns false and sets errno if
+ * a thread could not be started, in this case no worker is running.
+ */
+bool render_pool_start(int nthreads, void (*notify)(void));
+
+/**
+ * Runs all submitted jobs and stops the worker threads. Finished jobs remain
+ * to be taken.
+ */
+void render_pool_stop(void);
+
+/**
+ * Returns the number of running worker threads.
+ */
+int render_pool_threads(void);
+
+/**
+ * Queues the job for the next free worker. If no worker is running, the job is
+ * run immediately. Called from the main thread only.
+ */
+void render_pool_submit(RenderJob* job);
+
+/**
+ * Takes all finished jobs, returns a list in the order in which the jobs were
+ * finished or NULL.
+ */
+RenderJob* render_pool_take(void);
+
+#endif /* !_WIN32 */
+
+/* -------------------------------------------------------------------------------------------- */
+
+#endif /* NOCURSES_RENDER_POOL_H */
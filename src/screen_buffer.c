@@ -0,0 +1,226 @@
+#include "screen_buffer.h"
+#include "grapheme.h"
+
+/* -------------------------------------------------------------------------------------------- */
+
+#define READ_RETRIES 100
+
+static AtomicCounter registryLock = 0;
+static ScreenBuffer* registry     = NULL;
+static int           lastId       = 0;
+
+static void lockRegistry()
+{
+    while (!atomic_set_if_equal(&registryLock, 0, 1)) {
+        /* only held for list operations */
+    }
+}
+
+static void unlockRegistry()
+{
+    atomic_set(&registryLock, 0);
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+static void setBlank(ScreenCell* c, int fg, int bg, int attrs)
+{
+    c->text[0] = ' ';
+    c->len     = 1;
+    c->fg      = fg;
+    c->bg      = bg;
+    c->attrs   = attrs;
+}
+
+ScreenBuffer* screen_buffer_new(int width, int height)
+{
+    if (   width <= 0 || height <= 0 || width > SCREEN_MAX_SIZE || height > SCREEN_MAX_SIZE
+        || (size_t)width * height > SIZE_MAX / sizeof(ScreenCell))
+    {
+        return NULL;
+    }
+    ScreenBuffer* sb = (ScreenBuffer*) calloc(1, sizeof(ScreenBuffer));
+    if (!sb) {
+        return NULL;
+    }
+    size_t n = (size_t)width * height;
+    sb->width    = width;
+    sb->height   = height;
+    sb->rowseq   = (AtomicCounter*) calloc(height, sizeof(AtomicCounter));
+    sb->flushseq = (int*)           malloc(height * sizeof(int));
+    sb->cells    = (ScreenCell*)    malloc(n * sizeof(ScreenCell));
+    sb->shown    = (ScreenCell*)    malloc(n * sizeof(ScreenCell));
+    if (!sb->rowseq || !sb->flushseq || !sb->cells || !sb->shown) {
+        free(sb->rowseq);
+        free(sb->flushseq);
+        free(sb->cells);
+        free(sb->shown);
+        free(sb);
+        return NULL;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        setBlank(sb->cells + i, SCREEN_COLOR_DEFAULT, SCREEN_COLOR_DEFAULT, 0);
+    }
+    screen_buffer_invalidate(sb);
+    sb->refcnt = 1;
+
+    lockRegistry();
+    sb->id   = ++lastId;
+    sb->next = registry;
+    registry = sb;
+    unlockRegistry();
+    return sb;
+}
+
+ScreenBuffer* screen_buffer_find(int id)
+{
+    lockRegistry();
+    ScreenBuffer* sb = registry;
+    while (sb && sb->id != id) {
+        sb = sb->next;
+    }
+    if (sb) {
+        sb->refcnt += 1;
+    }
+    unlockRegistry();
+    return sb;
+}
+
+void screen_buffer_retain(ScreenBuffer* sb)
+{
+    lockRegistry();
+    sb->refcnt += 1;
+    unlockRegistry();
+}
+
+void screen_buffer_release(ScreenBuffer* sb)
+{
+    lockRegistry();
+    bool last = (--sb->refcnt == 0);
+    if (last) {
+        ScreenBuffer** p = &registry;
+        while (*p != sb) {
+            p = &(*p)->next;
+        }
+        *p = sb->next;
+    }
+    unlockRegistry();
+    if (last) {
+        free(sb->rowseq);
+        free(sb->flushseq);
+        free(sb->cells);
+        free(sb->shown);
+        free(sb);
+    }
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+static void beginRow(ScreenBuffer* sb, int y)
+{
+    AtomicCounter* seq = sb->rowseq + y;
+    while (true) {
+        int s = atomic_get(seq);
+        if ((s & 1) == 0 && atomic_set_if_equal(seq, s, s + 1)) {
+            return;
+        }
+    }
+}
+
+static void endRow(ScreenBuffer* sb, int y)
+{
+    atomic_inc(sb->rowseq + y);
+}
+
+int screen_buffer_put(ScreenBuffer* sb, int x, int y, const char* text, size_t len,
+                      int fg, int bg, int attrs)
+{
+    if (y < 0 || y >= sb->height || x >= sb->width) {
+        return 0;
+    }
+    const unsigned char* p = (const unsigned char*) text;
+    while (x < 0 && len > 0) {
+        size_t n = grapheme_length(p, len);
+        if (n == 0) {
+            return 0;
+        }
+        p += n; len -= n; x += 1;
+    }
+    int cnt = 0;
+    beginRow(sb, y);
+    ScreenCell* c = sb->cells + (size_t)y * sb->width + x;
+    while (x + cnt < sb->width && len > 0) {
+        size_t n = grapheme_length(p, len);
+        if (n == 0) {
+            break;  /* incomplete code point at the end */
+        }
+        size_t m = n;
+        if (m > SCREEN_CELL_TEXT) {
+            uint32_t cp;
+            int      k = utf8_decode(p, len, &cp);
+            m = (k > 0) ? k : 1;  /* keep the base character only */
+        }
+        memcpy(c->text, p, m);
+        c->len   = m;
+        c->fg    = fg;
+        c->bg    = bg;
+        c->attrs = attrs;
+        p += n; len -= n; c += 1; cnt += 1;
+    }
+    endRow(sb, y);
+    return cnt;
+}
+
+void screen_buffer_fill(ScreenBuffer* sb, int x, int y, int w, int h,
+                        int fg, int bg, int attrs)
+{
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > sb->width)  { w = sb->width  - x; }
+    if (y + h > sb->height) { h = sb->height - y; }
+    for (int r = y; r < y + h && w > 0; ++r) {
+        beginRow(sb, r);
+        ScreenCell* c = sb->cells + (size_t)r * sb->width + x;
+        for (int i = 0; i < w; ++i) {
+            setBlank(c + i, fg, bg, attrs);
+        }
+        endRow(sb, r);
+    }
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+bool screen_buffer_read_row(ScreenBuffer* sb, int y, ScreenCell* out)
+{
+    AtomicCounter* seq = sb->rowseq + y;
+    for (int i = 0; i < READ_RETRIES; ++i) {
+        int s1 = atomic_get(seq);
+        if (s1 == sb->flushseq[y]) {
+            return false;
+        }
+        if (s1 & 1) {
+            continue;
+        }
+        memcpy(out, sb->cells + (size_t)y * sb->width, sb->width * sizeof(ScreenCell));
+        atomic_fence();
+        if (atomic_get(seq) == s1) {
+            sb->flushseq[y] = s1;
+            return true;
+        }
+    }
+    return false;
+}
+
+void screen_buffer_invalidate(ScreenBuffer* sb)
+{
+    for (int y = 0; y < sb->height; ++y) {
+        sb->flushseq[y] = -1;
+    }
+    size_t n = (size_t)sb->width * sb->height;
+    for (size_t i = 0; i < n; ++i) {
+        sb->shown[i].len = 0;  /* matches no cell */
+    }
+    sb->target = -1;
+}
+
+/* -------------------------------------------------------------------------------------------- */
@@ -0,0 +1,122 @@
+#ifndef NOCURSES_SCREEN_BUFFER_H
+#define NOCURSES_SCREEN_BUFFER_H
+
+#include "util.h"
+#include "async_util.h"
+
+#include <stdint.h>
+
+/* -------------------------------------------------------------------------------------------- */
+
+/*
+ * Cell buffer that may be written from any thread and is flushed to the terminal
+ * by the main thread. Every row has a sequence counter that is odd while the row
+ * is written. Writers of the same row are serialised by incrementing the counter,
+ * the main thread never blocks writers: it copies a row and retries if the counter
+ * has changed meanwhile. Rows whose counter is unchanged since the last flush are
+ * skipped.
+ *
+ * Buffers are registered with an id, so that other Lua states can look up a
+ * buffer that was created in the main state.
+ */
+
+#define SCREEN_CELL_TEXT      12  /* maximal bytes of one grapheme cluster */
+#define SCREEN_MAX_SIZE    65535  /* maximal number of columns and rows */
+
+#define SCREEN_COLOR_DEFAULT   9
+
+#define SCREEN_ATTR_BOLD       0x01
+#define SCREEN_ATTR_UNDERLINE  0x02
+#define SCREEN_ATTR_BLINK      0x04
+#define SCREEN_ATTR_INVERT     0x08
+
+typedef struct ScreenCell
+{
+    char    text[SCREEN_CELL_TEXT];  /* UTF-8, not terminated */
+    uint8_t len;
+    uint8_t fg;                      /* 0..7 or SCREEN_COLOR_DEFAULT */
+    uint8_t bg;                      /* 0..7 or SCREEN_COLOR_DEFAULT */
+    uint8_t attrs;                   /* SCREEN_ATTR_* flags */
+
+} ScreenCell;
+
+typedef struct ScreenBuffer ScreenBuffer;
+
+struct ScreenBuffer
+{
+    ScreenBuffer*  next;       /* registry list */
+    int            refcnt;     /* guarded by the registry lock */
+    int            id;
+    int            width;
+    int            height;
+    AtomicCounter* rowseq;     /* sequence counter per row */
+    ScreenCell*    cells;      /* shared content, width * height */
+
+    /* only used by the flushing thread, i.e. the main thread or the render worker */
+    int*           flushseq;   /* row sequence counter of the last flush, -1 if unknown */
+    ScreenCell*    shown;      /* content of the last flush */
+    void*          render;     /* pending render of the main thread, NULL if none */
+    int            target;     /* terminal the shown content belongs to, -1 if none */
+};
+
+/* -------------------------------------------------------------------------------------------- */
+
+#define screen_buffer_new         nocurses_screen_buffer_new
+#define screen_buffer_find        nocurses_screen_buffer_find
+#define screen_buffer_retain      nocurses_screen_buffer_retain
+#define screen_buffer_release     nocurses_screen_buffer_release
+#define screen_buffer_put         nocurses_screen_buffer_put
+#define screen_buffer_fill        nocurses_screen_buffer_fill
+#define screen_buffer_read_row    nocurses_screen_buffer_read_row
+#define screen_buffer_invalidate  nocurses_screen_buffer_invalidate
+
+/**
+ * Creates a registered buffer filled with blanks. The reference counter is 1.
+ * Returns NULL if out of memory or if the size is invalid.
+ */
+ScreenBuffer* screen_buffer_new(int width, int height);
+
+/**
+ * Returns the buffer with the given id and increases its reference counter or
+ * returns NULL if no such buffer exists.
+ */
+ScreenBuffer* screen_buffer_find(int id);
+
+void screen_buffer_retain(ScreenBuffer* sb);
+
+/**
+ * Decreases the reference counter, the buffer is unregistered and freed if
+ * no reference is left.
+ */
+void screen_buffer_release(ScreenBuffer* sb);
+
+/**
+ * Writes UTF-8 text into row y starting at column x (0-based), one grapheme
+ * cluster per cell. Text beyond the row end is clipped. Returns the number of
+ * written cells. May be called from any thread.
+ */
+int screen_buffer_put(ScreenBuffer* sb, int x, int y, const char* text, size_t len,
+                      int fg, int bg, int attrs);
+
+/**
+ * Fills the given rectangle with blanks. May be called from any thread.
+ */
+void screen_buffer_fill(ScreenBuffer* sb, int x, int y, int w, int h,
+                        int fg, int bg, int attrs);
+
+/**
+ * Copies row y into out (width cells) if it was changed since the last call
+ * for this row and stores the row as flushed. Returns false if the row is
+ * unchanged or currently written. Called from the flushing thread only.
+ */
+bool screen_buffer_read_row(ScreenBuffer* sb, int y, ScreenCell* out);
+
+/**
+ * Marks all rows as changed, so that the next flush redraws everything, and
+ * resets the target. Called from the flushing thread only.
+ */
+void screen_buffer_invalidate(ScreenBuffer* sb);
+
+/* -------------------------------------------------------------------------------------------- */
+
+#endif /* NOCURSES_SCREEN_BUFFER_H */
@@ -0,0 +1,67 @@
+#include "spsc_ring.h"
+
+/* -------------------------------------------------------------------------------------------- */
+
+bool spsc_ring_init(SpscRing* r, int cap)
+{
+    int c = 1;
+    while (c < cap) {
+        c <<= 1;
+    }
+    r->data = (unsigned char*) malloc(c);
+    if (!r->data) {
+        return false;
+    }
+    r->cap = c;
+    atomic_set(&r->head, 0);
+    atomic_set(&r->tail, 0);
+    return true;
+}
+
+void spsc_ring_free(SpscRing* r)
+{
+    free(r->data);
+    r->data = NULL;
+    r->cap  = 0;
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+static inline int distance(SpscRing* r, int from, int to)
+{
+    return (to - from) & (2 * r->cap - 1);
+}
+
+int spsc_ring_used(SpscRing* r)
+{
+    return distance(r, atomic_get(&r->tail), atomic_get(&r->head));
+}
+
+int spsc_ring_space(SpscRing* r)
+{
+    return r->cap - distance(r, atomic_get(&r->tail), atomic_get(&r->head));
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+void spsc_ring_write(SpscRing* r, const void* data, int n)
+{
+    int head  = atomic_get(&r->head);
+    int pos   = head & (r->cap - 1);
+    int first = (n < r->cap - pos) ? n : r->cap - pos;
+    memcpy(r->data + pos, data, first);
+    memcpy(r->data, (const unsigned char*)data + first, n - first);
+    atomic_set(&r->head, (head + n) & (2 * r->cap - 1));  /* publishes the bytes */
+}
+
+void spsc_ring_read(SpscRing* r, void* data, int n)
+{
+    int tail  = atomic_get(&r->tail);
+    int pos   = tail & (r->cap - 1);
+    int first = (n < r->cap - pos) ? n : r->cap - pos;
+    memcpy(data, r->data + pos, first);
+    memcpy((unsigned char*)data + first, r->data, n - first);
+    atomic_set(&r->tail, (tail + n) & (2 * r->cap - 1));  /* releases the space */
+}
+
+/* -------------------------------------------------------------------------------------------- */
@@ -0,0 +1,66 @@
+#ifndef NOCURSES_SPSC_RING_H
+#define NOCURSES_SPSC_RING_H
+
+#include "util.h"
+#include "async_util.h"
+
+/* -------------------------------------------------------------------------------------------- */
+
+/*
+ * Lock-free byte ring for exactly one producer thread and one consumer thread.
+ * The producer only modifies head, the consumer only modifies tail. Positions
+ * are counted modulo 2 * cap, so that a full ring can be distinguished from 
+ * an empty ring without wasting a byte.
+ */
+
+typedef struct SpscRing
+{
+    unsigned char* data;
+    int            cap;    /* power of two */
+    AtomicCounter  head;   /* write position */
+    AtomicCounter  tail;   /* read position */
+
+} SpscRing;
+
+/* -------------------------------------------------------------------------------------------- */
+
+#define spsc_ring_init    nocurses_spsc_ring_init
+#define spsc_ring_free    nocurses_spsc_ring_free
+#define spsc_ring_used    nocurses_spsc_ring_used
+#define spsc_ring_space   nocurses_spsc_ring_space
+#define spsc_ring_write   nocurses_spsc_ring_write
+#define spsc_ring_read    nocurses_spsc_ring_read
+
+/**
+ * Allocates the ring, cap is rounded up to a power of two. Returns false if 
+ * out of memory.
+ */
+bool spsc_ring_init(SpscRing* r, int cap);
+
+void spsc_ring_free(SpscRing* r);
+
+/**
+ * Number of bytes that can be read, may be called from the consumer thread.
+ */
+int spsc_ring_used(SpscRing* r);
+
+/**
+ * Number of bytes that can be written, may be called from the producer thread.
+ */
+int spsc_ring_space(SpscRing* r);
+
+/**
+ * Writes n bytes, n must not be greater than spsc_ring_space(). The bytes
+ * become visible for the consumer at once. Called from the producer thread.
+ */
+void spsc_ring_write(SpscRing* r, const void* data, int n);
+
+/**
+ * Reads n bytes, n must not be greater than spsc_ring_used(). Called from the 
+ * consumer thread.
+ */
+void spsc_ring_read(SpscRing* r, void* data, int n);
+
+/* -------------------------------------------------------------------------------------------- */
+
+#endif /* NOCURSES_SPSC_RING_H */
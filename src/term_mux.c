@@ -0,0 +1,299 @@
+#ifndef _WIN32
+
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__linux__)
+# include <sys/epoll.h>
+#endif
+
+#include "term_mux.h"
+
+/* -------------------------------------------------------------------------------------------- */
+
+#define WANT_READ   1
+#define WANT_WRITE  2
+
+#define EPOLL_BATCH 64
+
+void term_mux_init(TermMux* m)
+{
+    memset(m, 0, sizeof(TermMux));
+    m->epfd = -1;
+}
+
+void term_mux_done(TermMux* m)
+{
+    while (m->cnt > 0) {
+        term_mux_remove(m, m->entries[m->cnt - 1]);
+    }
+    if (m->epfd >= 0) {
+        close(m->epfd);
+    }
+    free(m->entries);
+    term_mux_init(m);
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+static int wantedInterest(Terminal* t)
+{
+    int w = 0;
+    if (!t->eof && t->inlen - t->inpos < TERM_MUX_INPUT_LIMIT) {
+        w |= WANT_READ;
+    }
+    if (t->outlen > 0) {
+        w |= WANT_WRITE;
+    }
+    return w;
+}
+
+#if defined(__linux__)
+
+/* the registration of a separate output fd is marked by the lowest pointer bit */
+#define OUTPUT_TAG(e)     ((void*)((char*)(e) + 1))
+#define IS_OUTPUT_TAG(p)  (((uintptr_t)(p)) & 1)
+#define UNTAG(p)          ((TermMuxEntry*)((uintptr_t)(p) & ~(uintptr_t)1))
+
+static uint32_t toEpoll(int w)
+{
+    return ((w & WANT_READ) ? EPOLLIN : 0) | ((w & WANT_WRITE) ? EPOLLOUT : 0);
+}
+
+static void setEpoll(TermMux* m, int fd, void* ptr, uint32_t oldEv, uint32_t newEv)
+{
+    if (oldEv == newEv) {
+        return;
+    }
+    struct epoll_event ev;
+    ev.events   = newEv;
+    ev.data.ptr = ptr;
+    int op = !oldEv ? EPOLL_CTL_ADD : !newEv ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+    epoll_ctl(m->epfd, op, fd, &ev);  /* fails only if fd was closed, that removes it anyway */
+}
+
+#endif
+
+void term_mux_update(TermMux* m, TermMuxEntry* e)
+{
+    Terminal* t = e->term;
+    int       w = (e->index >= 0) ? wantedInterest(t) : 0;
+#if defined(__linux__)
+    if (m->epfd >= 0) {
+        int old = e->interest;
+        if (t->infd == t->outfd) {
+            setEpoll(m, t->infd, e, toEpoll(old), toEpoll(w));
+        } else {
+            setEpoll(m, t->infd,  e,             toEpoll(old & WANT_READ),  toEpoll(w & WANT_READ));
+            setEpoll(m, t->outfd, OUTPUT_TAG(e), toEpoll(old & WANT_WRITE), toEpoll(w & WANT_WRITE));
+        }
+    }
+#endif
+    e->interest = w;
+}
+
+bool term_mux_add(TermMux* m, TermMuxEntry* e)
+{
+    if (e->index >= 0) {
+        return true;
+    }
+#if defined(__linux__)
+    if (m->epfd < 0) {
+        m->epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (m->epfd < 0) {
+            return false;
+        }
+    }
+#endif
+    if (m->cnt == m->cap) {
+        int            newcap = m->cap ? 2 * m->cap : 16;
+        TermMuxEntry** newptr = (TermMuxEntry**) realloc(m->entries, newcap * sizeof(TermMuxEntry*));
+        if (!newptr) {
+            errno = ENOMEM;
+            return false;
+        }
+        m->entries = newptr;
+        m->cap     = newcap;
+    }
+    Terminal* t = e->term;
+    e->inflags  = fcntl(t->infd,  F_GETFL);
+    e->outflags = fcntl(t->outfd, F_GETFL);
+    if (e->inflags >= 0) {
+        fcntl(t->infd,  F_SETFL, e->inflags  | O_NONBLOCK);
+    }
+    if (e->outflags >= 0) {
+        fcntl(t->outfd, F_SETFL, e->outflags | O_NONBLOCK);
+    }
+
+    e->index    = m->cnt;
+    e->interest = 0;
+    e->events   = 0;
+    e->queued   = false;
+    m->entries[m->cnt++] = e;
+    term_mux_update(m, e);
+    return true;
+}
+
+void term_mux_remove(TermMux* m, TermMuxEntry* e)
+{
+    if (e->index < 0) {
+        return;
+    }
+    int i = e->index;
+    e->index = -1;
+    term_mux_update(m, e);  /* unregisters */
+
+    Terminal* t = e->term;
+    if (e->outflags >= 0 && t->outfd != t->infd) {
+        fcntl(t->outfd, F_SETFL, e->outflags);
+    }
+    if (e->inflags >= 0) {
+        fcntl(t->infd,  F_SETFL, e->inflags);
+    }
+
+    m->cnt -= 1;
+    if (i < m->cnt) {
+        m->entries[i] = m->entries[m->cnt];
+        m->entries[i]->index = i;
+    }
+
+    if (e->queued) {
+        TermMuxEntry** p    = &m->readyfirst;
+        TermMuxEntry*  prev = NULL;
+        while (*p != e) {
+            prev = *p;
+            p    = &(*p)->readynext;
+        }
+        *p = e->readynext;
+        if (m->readylast == e) {
+            m->readylast = prev;
+        }
+        e->queued = false;
+    }
+    e->events = 0;
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+static void service(TermMux* m, TermMuxEntry* e, bool readable, bool writable)
+{
+    Terminal* t  = e->term;
+    int       ev = 0;
+    if (writable && t->outlen > 0) {
+        int rc = terminal_flush(t);
+        if (rc > 0) {
+            ev |= TERM_MUX_DRAINED;
+        } else if (rc < 0) {
+            t->outlen = 0;  /* peer is gone */
+            t->eof    = true;
+            ev |= TERM_MUX_CLOSED;
+        }
+    }
+    if (readable && !t->eof) {
+        int rc = terminal_read(t);
+        if (rc > 0) {
+            ev |= TERM_MUX_INPUT;
+        } else if (rc < 0 && t->eof) {
+            ev |= TERM_MUX_CLOSED;
+        }
+    }
+    term_mux_update(m, e);
+    if (ev) {
+        e->events |= ev;
+        if (!e->queued) {
+            e->queued    = true;
+            e->readynext = NULL;
+            if (m->readylast) {
+                m->readylast->readynext = e;
+            } else {
+                m->readyfirst = e;
+            }
+            m->readylast = e;
+        }
+    }
+}
+
+void term_mux_prepare(TermMux* m, fd_set* rfds, fd_set* wfds, int* nfds)
+{
+#if defined(__linux__)
+    (void)wfds;  /* output is waited for by epoll */
+    if (m->epfd >= 0 && m->cnt > 0) {
+        FD_SET(m->epfd, rfds);
+        if (m->epfd >= *nfds) {
+            *nfds = m->epfd + 1;
+        }
+    }
+#else
+    for (int i = 0; i < m->cnt; ++i) {
+        const TermMuxEntry* e = m->entries[i];
+        const Terminal*     t = e->term;
+        if ((e->interest & WANT_READ) && t->infd < FD_SETSIZE) {
+            FD_SET(t->infd, rfds);
+            if (t->infd >= *nfds) {
+                *nfds = t->infd + 1;
+            }
+        }
+        if ((e->interest & WANT_WRITE) && t->outfd < FD_SETSIZE) {
+            FD_SET(t->outfd, wfds);
+            if (t->outfd >= *nfds) {
+                *nfds = t->outfd + 1;
+            }
+        }
+    }
+#endif
+}
+
+bool term_mux_collect(TermMux* m, fd_set* rfds, fd_set* wfds)
+{
+    bool found = false;
+#if defined(__linux__)
+    (void)wfds;
+    if (m->epfd < 0 || !FD_ISSET(m->epfd, rfds)) {
+        return false;
+    }
+    /* epoll is level triggered, terminals beyond the batch are serviced on the next wait */
+    struct epoll_event evs[EPOLL_BATCH];
+    int                n = epoll_wait(m->epfd, evs, EPOLL_BATCH, 0);
+    for (int i = 0; i < n; ++i) {
+        TermMuxEntry* e    = UNTAG(evs[i].data.ptr);
+        uint32_t      ev   = evs[i].events;
+        bool          fail = (ev & (EPOLLERR | EPOLLHUP)) != 0;
+        if (IS_OUTPUT_TAG(evs[i].data.ptr)) {
+            service(m, e, false, (ev & EPOLLOUT) || fail);
+        } else if (e->term->infd == e->term->outfd) {
+            service(m, e, (ev & EPOLLIN) || fail, (ev & EPOLLOUT) || fail);
+        } else {
+            service(m, e, (ev & EPOLLIN) || fail, false);
+        }
+        found = true;
+    }
+#else
+    for (int i = 0; i < m->cnt; ++i) {
+        TermMuxEntry* e = m->entries[i];
+        Terminal*     t = e->term;
+        bool readable = (e->interest & WANT_READ)  && t->infd  < FD_SETSIZE && FD_ISSET(t->infd,  rfds);
+        bool writable = (e->interest & WANT_WRITE) && t->outfd < FD_SETSIZE && FD_ISSET(t->outfd, wfds);
+        if (readable || writable) {
+            service(m, e, readable, writable);
+            found = true;
+        }
+    }
+#endif
+    return found;
+}
+
+TermMuxEntry* term_mux_next(TermMux* m)
+{
+    TermMuxEntry* e = m->readyfirst;
+    if (e) {
+        m->readyfirst = e->readynext;
+        if (!m->readyfirst) {
+            m->readylast = NULL;
+        }
+        e->queued = false;
+    }
+    return e;
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+#endif /* !_WIN32 */
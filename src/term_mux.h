@@ -0,0 +1,112 @@
+#ifndef NOCURSES_TERM_MUX_H
+#define NOCURSES_TERM_MUX_H
+
+#ifndef _WIN32
+
+#include <sys/select.h>
+
+#include "terminal.h"
+
+/* -------------------------------------------------------------------------------------------- */
+
+/*
+ * Multiplexer for many terminals in one wait. On Linux the terminal file
+ * descriptors are registered in an epoll instance whose file descriptor is part
+ * of the select set of the main wait, so the number of terminals is not limited
+ * by FD_SETSIZE. On other platforms the terminal file descriptors are added to
+ * the select set directly.
+ *
+ * Ready terminals are serviced without blocking: available input is read into
+ * the input buffer and pending output is written as far as the output file
+ * descriptor accepts it. Terminals with events to report are queued in the order
+ * in which they became ready.
+ */
+
+#define TERM_MUX_INPUT    0x01  /* input was appended to the input buffer */
+#define TERM_MUX_CLOSED   0x02  /* input has ended */
+#define TERM_MUX_DRAINED  0x04  /* pending output was written completely */
+
+/* input is not read while the input buffer holds at least this many bytes */
+#define TERM_MUX_INPUT_LIMIT  (16 * 1024)
+
+typedef struct TermMuxEntry TermMuxEntry;
+
+struct TermMuxEntry
+{
+    Terminal*     term;
+    int           index;      /* index in TermMux.entries, -1 if not added */
+    int           interest;   /* registered read / write interest */
+    int           events;     /* TERM_MUX_* flags to report */
+    TermMuxEntry* readynext;
+    bool          queued;
+    int           inflags;    /* file status flags before adding, restored on removal */
+    int           outflags;
+};
+
+typedef struct TermMux
+{
+    int            epfd;      /* -1 if not used */
+    TermMuxEntry** entries;
+    int            cnt;
+    int            cap;
+    TermMuxEntry*  readyfirst;
+    TermMuxEntry*  readylast;
+
+} TermMux;
+
+/* -------------------------------------------------------------------------------------------- */
+
+#define term_mux_init     nocurses_term_mux_init
+#define term_mux_done     nocurses_term_mux_done
+#define term_mux_add      nocurses_term_mux_add
+#define term_mux_remove   nocurses_term_mux_remove
+#define term_mux_update   nocurses_term_mux_update
+#define term_mux_prepare  nocurses_term_mux_prepare
+#define term_mux_collect  nocurses_term_mux_collect
+#define term_mux_next     nocurses_term_mux_next
+
+void term_mux_init(TermMux* m);
+
+/**
+ * Removes all entries and frees the multiplexer.
+ */
+void term_mux_done(TermMux* m);
+
+/**
+ * Adds the entry and makes the file descriptors of its terminal non-blocking.
+ * Returns false and sets errno on failure.
+ */
+bool term_mux_add(TermMux* m, TermMuxEntry* e);
+
+/**
+ * Removes the entry and restores the file status flags of its terminal.
+ */
+void term_mux_remove(TermMux* m, TermMuxEntry* e);
+
+/**
+ * Registers interest in input and output according to the buffer state of the
+ * terminal. Must be called after input was consumed or output was appended.
+ */
+void term_mux_update(TermMux* m, TermMuxEntry* e);
+
+/**
+ * Adds the file descriptors to be waited for to the select sets.
+ */
+void term_mux_prepare(TermMux* m, fd_set* rfds, fd_set* wfds, int* nfds);
+
+/**
+ * Services the ready terminals after select has returned. Returns true if some
+ * file descriptor was ready.
+ */
+bool term_mux_collect(TermMux* m, fd_set* rfds, fd_set* wfds);
+
+/**
+ * Removes the next entry with events to report from the queue or returns NULL.
+ */
+TermMuxEntry* term_mux_next(TermMux* m);
+
+/* -------------------------------------------------------------------------------------------- */
+
+#endif /* !_WIN32 */
+
+#endif /* NOCURSES_TERM_MUX_H */
@@ -0,0 +1,286 @@
+#ifndef _WIN32
+
+#include <poll.h>
+#include <stdarg.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "terminal.h"
+
+/* -------------------------------------------------------------------------------------------- */
+
+#define INITIAL_CAP    256
+#define MAX_INPUT_CAP  (64 * 1024)
+
+bool terminal_init(Terminal* t, int infd, int outfd)
+{
+    memset(t, 0, sizeof(Terminal));
+    t->infd   = infd;
+    t->outfd  = outfd;
+    t->inbuf  = (unsigned char*) malloc(INITIAL_CAP);
+    t->outbuf = (char*)          malloc(INITIAL_CAP);
+    if (!t->inbuf || !t->outbuf) {
+        free(t->inbuf);
+        free(t->outbuf);
+        t->inbuf  = NULL;
+        t->outbuf = NULL;
+        return false;
+    }
+    t->incap  = INITIAL_CAP;
+    t->outcap = INITIAL_CAP;
+    return true;
+}
+
+bool terminal_init_vterm(Terminal* t, VTerm* vt)
+{
+    if (!terminal_init(t, -1, -1)) {
+        return false;
+    }
+    vterm_retain(vt);
+    t->vterm = vt;
+    return true;
+}
+
+void terminal_done(Terminal* t)
+{
+    terminal_setraw(t, false);
+    terminal_flush(t);
+    if (t->vterm) {
+        vterm_release(t->vterm);
+        t->vterm = NULL;
+    }
+    free(t->inbuf);
+    free(t->outbuf);
+    t->inbuf  = NULL;
+    t->outbuf = NULL;
+    t->inlen  = t->inpos  = t->incap = 0;
+    t->outlen = t->outcap = 0;
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+bool terminal_setraw(Terminal* t, bool raw)
+{
+    if (t->raw == raw) {
+        return true;
+    }
+    if (t->vterm) {
+        t->raw = raw;
+        return true;
+    }
+    if (raw) {
+        if (tcgetattr(t->infd, &t->oldattr) != 0) {
+            return false;
+        }
+        struct termios newattr = t->oldattr;
+        newattr.c_lflag &= ~(ICANON | ECHO);
+        if (tcsetattr(t->infd, TCSANOW, &newattr) != 0) {
+            return false;
+        }
+    } else {
+        tcsetattr(t->infd, TCSANOW, &t->oldattr);
+    }
+    t->raw = raw;
+    return true;
+}
+
+bool terminal_getsize(Terminal* t, int* cols, int* rows)
+{
+    if (t->cols > 0 && t->rows > 0) {
+        *cols = t->cols;
+        *rows = t->rows;
+        return true;
+    }
+    if (t->vterm) {
+        *cols = t->vterm->cols;
+        *rows = t->vterm->rows;
+        return true;
+    }
+    struct winsize w;
+    if (ioctl(t->outfd, TIOCGWINSZ, &w) == 0 && w.ws_col > 0 && w.ws_row > 0) {
+        *cols = w.ws_col;
+        *rows = w.ws_row;
+        return true;
+    }
+    return false;
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+static bool reserveOutput(Terminal* t, size_t len)
+{
+    if (t->outlen + len > t->outcap) {
+        size_t newcap = t->outcap * 2;
+        while (newcap < t->outlen + len) {
+            newcap *= 2;
+        }
+        char* newbuf = (char*) realloc(t->outbuf, newcap);
+        if (!newbuf) {
+            return false;
+        }
+        t->outbuf = newbuf;
+        t->outcap = newcap;
+    }
+    return true;
+}
+
+bool terminal_write(Terminal* t, const void* data, size_t len)
+{
+    if (!reserveOutput(t, len)) {
+        return false;
+    }
+    memcpy(t->outbuf + t->outlen, data, len);
+    t->outlen += len;
+    return true;
+}
+
+bool terminal_printf(Terminal* t, const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(t->outbuf + t->outlen, t->outcap - t->outlen, fmt, args);
+    va_end(args);
+    if (n < 0) {
+        return false;
+    }
+    if ((size_t)n >= t->outcap - t->outlen) {
+        if (!reserveOutput(t, n + 1)) {
+            return false;
+        }
+        va_start(args, fmt);
+        vsnprintf(t->outbuf + t->outlen, t->outcap - t->outlen, fmt, args);
+        va_end(args);
+    }
+    t->outlen += n;
+    return true;
+}
+
+/* sockets are written without raising SIGPIPE if the peer is gone */
+static ssize_t writeOutput(Terminal* t, const char* data, size_t len)
+{
+#ifdef MSG_NOSIGNAL
+    if (!t->notsocket) {
+        ssize_t n = send(t->outfd, data, len, MSG_NOSIGNAL);
+        if (n >= 0 || errno != ENOTSOCK) {
+            return n;
+        }
+        t->notsocket = true;
+    }
+#endif
+    return write(t->outfd, data, len);
+}
+
+int terminal_flush(Terminal* t)
+{
+    if (t->vterm) {
+        vterm_write(t->vterm, t->outbuf, t->outlen);
+        t->outlen = 0;
+        return 1;
+    }
+    size_t written = 0;
+    int    rslt    = 1;
+    while (written < t->outlen) {
+        ssize_t n = writeOutput(t, t->outbuf + written, t->outlen - written);
+        if (n > 0) {
+            written += n;
+        }
+        else if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        else {
+            rslt = (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) ? 0 : -1;
+            break;
+        }
+    }
+    if (written > 0) {
+        memmove(t->outbuf, t->outbuf + written, t->outlen - written);
+        t->outlen -= written;
+    }
+    return rslt;
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+static bool reserveInput(Terminal* t)
+{
+    if (t->inpos > 0) {
+        memmove(t->inbuf, t->inbuf + t->inpos, t->inlen - t->inpos);
+        t->inlen -= t->inpos;
+        t->inpos  = 0;
+    }
+    if (t->inlen == t->incap) {
+        if (t->incap >= MAX_INPUT_CAP) {
+            return false;
+        }
+        unsigned char* newbuf = (unsigned char*) realloc(t->inbuf, t->incap * 2);
+        if (!newbuf) {
+            return false;
+        }
+        t->inbuf  = newbuf;
+        t->incap *= 2;
+    }
+    return true;
+}
+
+int terminal_read(Terminal* t)
+{
+    if (t->eof || !reserveInput(t)) {
+        return -1;
+    }
+    if (t->vterm) {
+        size_t n = vterm_take_input(t->vterm, t->inbuf + t->inlen, t->incap - t->inlen);
+        t->inlen += n;
+        return (n > 0) ? 1 : 0;
+    }
+    while (true) {
+        ssize_t n = read(t->infd, t->inbuf + t->inlen, t->incap - t->inlen);
+        if (n > 0) {
+            t->inlen += n;
+            return 1;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        }
+        t->eof = true;
+        return -1;
+    }
+}
+
+int terminal_fill(Terminal* t, double timeout)
+{
+    if (t->eof || !reserveInput(t)) {
+        return -1;
+    }
+    if (t->vterm) {
+        int rc = terminal_read(t);  /* there is nothing to wait for */
+        return (rc == 0) ? -2 : rc;
+    }
+    struct pollfd pfd;
+    pfd.fd     = t->infd;
+    pfd.events = POLLIN;
+    int ret;
+    do {
+        ret = poll(&pfd, 1, (timeout >= 0) ? (int)(timeout * 1000) : -1);
+    } while (ret < 0 && errno == EINTR);
+    if (ret == 0) {
+        return 0;
+    }
+    return terminal_read(t);
+}
+
+void terminal_consume(Terminal* t, size_t n)
+{
+    t->inpos += n;
+    if (t->inpos >= t->inlen) {
+        t->inpos = 0;
+        t->inlen = 0;
+    }
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+#endif /* !_WIN32 */
@@ -0,0 +1,126 @@
+#ifndef NOCURSES_TERMINAL_H
+#define NOCURSES_TERMINAL_H
+
+#ifndef _WIN32
+
+#include <termios.h>
+
+#include "util.h"
+#include "vterm.h"
+
+/* -------------------------------------------------------------------------------------------- */
+
+/*
+ * Terminal bound to an arbitrary file descriptor pair, e.g. a pty or a socket.
+ * Every terminal has its own input buffer, output buffer, termios state and size,
+ * so that many terminals can be driven from one process independently of stdin
+ * and stdout. A terminal may also be bound to a virtual terminal instead of file
+ * descriptors: its output is parsed by the virtual terminal and its input is taken
+ * from the input of the virtual terminal without waiting.
+ */
+
+typedef struct Terminal
+{
+    int            infd;
+    int            outfd;
+    bool           raw;
+    struct termios oldattr;
+    int            cols;      /* size given by terminal_setsize(), 0 if not given */
+    int            rows;
+    bool           eof;       /* input has ended */
+    bool           notsocket; /* output file descriptor is not a socket */
+    VTerm*         vterm;     /* instead of file descriptors, NULL if not used */
+
+    unsigned char* inbuf;
+    size_t         inpos;
+    size_t         inlen;
+    size_t         incap;
+
+    char*          outbuf;
+    size_t         outlen;
+    size_t         outcap;
+
+} Terminal;
+
+/* -------------------------------------------------------------------------------------------- */
+
+#define terminal_init      nocurses_terminal_init
+#define terminal_init_vterm nocurses_terminal_init_vterm
+#define terminal_done      nocurses_terminal_done
+#define terminal_setraw    nocurses_terminal_setraw
+#define terminal_getsize   nocurses_terminal_getsize
+#define terminal_write     nocurses_terminal_write
+#define terminal_printf    nocurses_terminal_printf
+#define terminal_flush     nocurses_terminal_flush
+#define terminal_fill      nocurses_terminal_fill
+#define terminal_read      nocurses_terminal_read
+#define terminal_consume   nocurses_terminal_consume
+
+/**
+ * Binds the terminal to the given file descriptors. The file descriptors are not
+ * closed by terminal_done(). Returns false if out of memory.
+ */
+bool terminal_init(Terminal* t, int infd, int outfd);
+
+/**
+ * Binds the terminal to the virtual terminal, the file descriptors are -1. The 
+ * virtual terminal is retained until terminal_done(). Returns false if out of memory.
+ */
+bool terminal_init_vterm(Terminal* t, VTerm* vt);
+
+/**
+ * Restores the termios state, writes pending output as far as possible and
+ * frees the buffers. A bound virtual terminal is released.
+ */
+void terminal_done(Terminal* t);
+
+/**
+ * Switches raw mode of the input file descriptor. Returns false and sets errno if
+ * the input file descriptor is not a terminal.
+ */
+bool terminal_setraw(Terminal* t, bool raw);
+
+/**
+ * Obtains the size given by terminal_setsize() or the window size of the output
+ * file descriptor. Returns false if the size is unknown.
+ */
+bool terminal_getsize(Terminal* t, int* cols, int* rows);
+
+/**
+ * Appends bytes to the output buffer. Returns false if out of memory.
+ */
+bool terminal_write(Terminal* t, const void* data, size_t len);
+
+bool terminal_printf(Terminal* t, const char* fmt, ...);
+
+/**
+ * Writes the output buffer. Returns 1 if all bytes were written, 0 if the output
+ * file descriptor would block and -1 on error (errno is set).
+ */
+int terminal_flush(Terminal* t);
+
+/**
+ * Waits up to timeout seconds (forever if negative) until input is available and
+ * appends it to the input buffer. Returns 1 if bytes were read, 0 on timeout,
+ * -1 if the input has ended or the input buffer is full and -2 without waiting
+ * if the terminal is bound to a virtual terminal that has no input.
+ */
+int terminal_fill(Terminal* t, double timeout);
+
+/**
+ * Reads available input without waiting, the input file descriptor should be 
+ * ready or non-blocking. Returns 1 if bytes were read, 0 if no input is available
+ * and -1 if the input has ended or the input buffer is full.
+ */
+int terminal_read(Terminal* t);
+
+/**
+ * Removes n bytes from the head of the input buffer.
+ */
+void terminal_consume(Terminal* t, size_t n);
+
+/* -------------------------------------------------------------------------------------------- */
+
+#endif /* !_WIN32 */
+
+#endif /* NOCURSES_TERMINAL_H */
@@ -0,0 +1,191 @@
+#include "timer_wheel.h"
+
+/* -------------------------------------------------------------------------------------------- */
+
+static inline int lowestBit(uint64_t bits) /* bits != 0 */
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(bits);
+#else
+    int rslt = 0;
+    while (!(bits & 1)) {
+        bits >>= 1;
+        ++rslt;
+    }
+    return rslt;
+#endif
+}
+
+/* first occupied slot index starting at index, -1 if none */
+static inline int nextOccupied(uint64_t occupied, int index)
+{
+    if (!occupied) {
+        return -1;
+    }
+    uint64_t rotated = index ? ((occupied >> index) | (occupied << (TIMER_WHEEL_SLOTS - index)))
+                             : occupied;
+    return (index + lowestBit(rotated)) & TIMER_WHEEL_MASK;
+}
+
+static inline int levelIndex(uint64_t ticks, int level)
+{
+    return (int)((ticks >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK);
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+void timer_wheel_init(TimerWheel* w, uint64_t now)
+{
+    w->now   = now;
+    w->count = 0;
+    for (int i = 0; i < TIMER_WHEEL_LEVELS; ++i) {
+        w->occupied[i] = 0;
+    }
+    for (int i = 0; i < TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS; ++i) {
+        w->slots[i].next = &w->slots[i];
+        w->slots[i].prev = &w->slots[i];
+        w->slots[i].slot = i;
+    }
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+static void insertNode(TimerWheel* w, TimerNode* node)
+{
+    uint64_t delta = node->expires - w->now;
+    uint64_t pos   = node->expires;
+    int      level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << ((level + 1) * TIMER_WHEEL_BITS))) {
+        ++level;
+    }
+    if (level == TIMER_WHEEL_LEVELS - 1) {
+        uint64_t max = ((uint64_t)1 << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS)) - 1;
+        if (delta > max) {
+            pos = w->now + max; /* will be cascaded again until due */
+        }
+    }
+    int        slot = level * TIMER_WHEEL_SLOTS + levelIndex(pos, level);
+    TimerNode* head = &w->slots[slot];
+    node->slot       = slot;
+    node->prev       = head->prev;
+    node->next       = head;
+    head->prev->next = node;
+    head->prev       = node;
+    w->occupied[level] |= ((uint64_t)1 << (slot & TIMER_WHEEL_MASK));
+}
+
+static void unlinkNode(TimerWheel* w, TimerNode* node)
+{
+    int slot = node->slot;
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->next = NULL;
+    node->prev = NULL;
+    node->slot = -1;
+    TimerNode* head = &w->slots[slot];
+    if (head->next == head) {
+        w->occupied[slot / TIMER_WHEEL_SLOTS] &= ~((uint64_t)1 << (slot & TIMER_WHEEL_MASK));
+    }
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+void timer_wheel_add(TimerWheel* w, TimerNode* node, uint64_t expires)
+{
+    if (expires <= w->now) {
+        expires = w->now + 1;
+    }
+    node->expires = expires;
+    insertNode(w, node);
+    w->count += 1;
+}
+
+void timer_wheel_remove(TimerWheel* w, TimerNode* node)
+{
+    if (node->slot >= 0) {
+        unlinkNode(w, node);
+        w->count -= 1;
+    }
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+static void cascade(TimerWheel* w, int level)
+{
+    int        slot = level * TIMER_WHEEL_SLOTS + levelIndex(w->now, level);
+    TimerNode* head = &w->slots[slot];
+    TimerNode* node = head->next;
+    head->next = head;
+    head->prev = head;
+    w->occupied[level] &= ~((uint64_t)1 << (slot & TIMER_WHEEL_MASK));
+    while (node != head) {
+        TimerNode* next = node->next;
+        insertNode(w, node);
+        node = next;
+    }
+}
+
+void timer_wheel_advance(TimerWheel* w, uint64_t now, TimerExpiredFunc expiredFunc, void* data)
+{
+    while (w->now < now) {
+        if (w->count == 0) {
+            w->now = now;
+            break;
+        }
+        if (w->occupied[0] == 0) {
+            /* nothing to expire on level 0: jump to the next wrap around */
+            uint64_t next = (w->now | TIMER_WHEEL_MASK) + 1;
+            if (next > now) {
+                w->now = now;
+                break;
+            }
+            w->now = next - 1;
+        }
+        w->now += 1;
+        for (int level = 1; level < TIMER_WHEEL_LEVELS; ++level) {
+            if (levelIndex(w->now, level - 1) != 0) {
+                break;
+            }
+            cascade(w, level);
+        }
+        int        slot = levelIndex(w->now, 0);
+        TimerNode* head = &w->slots[slot];
+        while (head->next != head) {
+            TimerNode* node = head->next;
+            unlinkNode(w, node);
+            w->count -= 1;
+            expiredFunc(node, data);
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+uint64_t timer_wheel_next(TimerWheel* w)
+{
+    if (w->count == 0) {
+        return TIMER_WHEEL_NEVER;
+    }
+    uint64_t rslt = TIMER_WHEEL_NEVER;
+    {
+        int index = nextOccupied(w->occupied[0], levelIndex(w->now + 1, 0));
+        if (index >= 0) {
+            rslt = w->now + 1 + ((index - levelIndex(w->now + 1, 0)) & TIMER_WHEEL_MASK);
+        }
+    }
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; ++level) {
+        int      shift = level * TIMER_WHEEL_BITS;
+        /* first tick at which a slot of this level is cascaded */
+        uint64_t first = ((w->now >> shift) + 1) << shift;
+        int      index = nextOccupied(w->occupied[level], levelIndex(first, level));
+        if (index >= 0) {
+            uint64_t t = first + ((uint64_t)((index - levelIndex(first, level)) & TIMER_WHEEL_MASK) << shift);
+            if (t < rslt) {
+                rslt = t;
+            }
+        }
+    }
+    return rslt;
+}
+
+/* -------------------------------------------------------------------------------------------- */
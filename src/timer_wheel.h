@@ -0,0 +1,80 @@
+#ifndef NOCURSES_TIMER_WHEEL_H
+#define NOCURSES_TIMER_WHEEL_H
+
+#include "util.h"
+
+#include <stdint.h>
+
+/* -------------------------------------------------------------------------------------------- */
+
+/*
+ * Hierarchical timer wheel with TIMER_WHEEL_LEVELS levels of TIMER_WHEEL_SLOTS slots. 
+ * Time is measured in ticks. Level n covers expiration times up to 64^(n+1) ticks ahead,
+ * timers of the upper levels are cascaded into the lower levels when the lower
+ * level wraps around. Adding, removing and expiring a timer are O(1) operations.
+ */
+
+#define TIMER_WHEEL_BITS    6
+#define TIMER_WHEEL_SLOTS   (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK    (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS  4
+
+#define TIMER_WHEEL_NEVER   UINT64_MAX
+
+typedef struct TimerNode TimerNode;
+
+struct TimerNode
+{
+    TimerNode* next;
+    TimerNode* prev;
+    uint64_t   expires;
+    int        slot;    /* level * TIMER_WHEEL_SLOTS + index or -1 if not in wheel */
+};
+
+typedef struct TimerWheel
+{
+    uint64_t  now;      /* last processed tick */
+    int       count;
+    uint64_t  occupied[TIMER_WHEEL_LEVELS];
+    TimerNode slots[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS];  /* list heads */
+
+} TimerWheel;
+
+typedef void (*TimerExpiredFunc)(TimerNode* node, void* data);
+
+/* -------------------------------------------------------------------------------------------- */
+
+#define timer_wheel_init     nocurses_timer_wheel_init
+#define timer_wheel_add      nocurses_timer_wheel_add
+#define timer_wheel_remove   nocurses_timer_wheel_remove
+#define timer_wheel_advance  nocurses_timer_wheel_advance
+#define timer_wheel_next     nocurses_timer_wheel_next
+
+void timer_wheel_init(TimerWheel* w, uint64_t now);
+
+/**
+ * Adds the node with the given expiration tick. Expiration ticks that are 
+ * not in the future are expired with the next tick.
+ */
+void timer_wheel_add(TimerWheel* w, TimerNode* node, uint64_t expires);
+
+void timer_wheel_remove(TimerWheel* w, TimerNode* node);
+
+/**
+ * Processes all ticks up to now and calls expiredFunc for every expired node. 
+ * The node is already removed from the wheel and may be added again from
+ * within expiredFunc.
+ */
+void timer_wheel_advance(TimerWheel* w, uint64_t now, TimerExpiredFunc expiredFunc, void* data);
+
+/**
+ * Returns the tick at which timer_wheel_advance() should be called next, or
+ * TIMER_WHEEL_NEVER if the wheel is empty. The result is never later than 
+ * the earliest expiration but may be earlier if timers of the upper levels
+ * must be cascaded first.
+ */
+uint64_t timer_wheel_next(TimerWheel* w);
+
+/* -------------------------------------------------------------------------------------------- */
+
+#endif /* NOCURSES_TIMER_WHEEL_H */
@@ -0,0 +1,143 @@
+#include "trace_ring.h"
+
+/* -------------------------------------------------------------------------------------------- */
+
+#define HEADER_SIZE sizeof(TraceHeader)
+
+bool trace_ring_init(TraceRing* r, size_t cap)
+{
+    memset(r, 0, sizeof(TraceRing));
+    r->data = (char*) malloc(cap);
+    if (!r->data) {
+        return false;
+    }
+    r->cap = cap;
+    return true;
+}
+
+void trace_ring_free(TraceRing* r)
+{
+    free(r->data);
+    memset(r, 0, sizeof(TraceRing));
+}
+
+void trace_ring_clear(TraceRing* r)
+{
+    r->head    = 0;
+    r->tail    = 0;
+    r->dropped = 0;
+}
+
+/* copies into the ring at the given position, wrapping at the end of the buffer */
+static void copyIn(TraceRing* r, uint64_t pos, const void* src, size_t len)
+{
+    size_t offs  = pos % r->cap;
+    size_t first = r->cap - offs;
+    if (len <= first) {
+        memcpy(r->data + offs, src, len);
+    } else {
+        memcpy(r->data + offs, src, first);
+        memcpy(r->data, (const char*)src + first, len - first);
+    }
+}
+
+static void copyOut(const TraceRing* r, uint64_t pos, void* dst, size_t len)
+{
+    size_t offs  = pos % r->cap;
+    size_t first = r->cap - offs;
+    if (len <= first) {
+        memcpy(dst, r->data + offs, len);
+    } else {
+        memcpy(dst, r->data + offs, first);
+        memcpy((char*)dst + first, r->data, len - first);
+    }
+}
+
+void trace_ring_record(TraceRing* r, double time, int dir, const char* tag,
+                       const void* data, size_t len)
+{
+    if (r->cap <= HEADER_SIZE) {
+        return;
+    }
+    TraceHeader h;
+    h.time  = time;
+    h.tag   = tag;
+    h.flags = dir;
+    size_t max = r->cap - HEADER_SIZE;
+    if (max > UINT32_MAX) {
+        max = UINT32_MAX;
+    }
+    if (len > max) {
+        data     = (const char*)data + (len - max);
+        len      = max;
+        h.flags |= TRACE_TRUNCATED;
+    }
+    h.len = (uint32_t)len;
+
+    size_t size = HEADER_SIZE + len;
+    while (r->head + size - r->tail > r->cap) {
+        TraceHeader old;
+        copyOut(r, r->tail, &old, HEADER_SIZE);
+        r->tail    += HEADER_SIZE + old.len;
+        r->dropped += 1;
+    }
+    copyIn(r, r->head, &h, HEADER_SIZE);
+    copyIn(r, r->head + HEADER_SIZE, data, len);
+    r->head += size;
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+void trace_ring_dump(const TraceRing* r, TraceWriter writer, void* ctx)
+{
+    char line[160];
+    int  n;
+    if (r->dropped > 0) {
+        n = snprintf(line, sizeof(line), "# %llu older records dropped\n",
+                     (unsigned long long)r->dropped);
+        writer(ctx, line, n);
+    }
+    uint64_t pos = r->tail;
+    while (pos < r->head) {
+        TraceHeader h;
+        copyOut(r, pos, &h, HEADER_SIZE);
+        pos += HEADER_SIZE;
+        n = snprintf(line, sizeof(line), "%.6f %s %-24s %5u%s ", h.time,
+                     (h.flags & TRACE_INPUT) ? "in " : "out", h.tag ? h.tag : "-",
+                     (unsigned)h.len, (h.flags & TRACE_TRUNCATED) ? "+" : "");
+        if (n >= (int)sizeof(line)) {
+            n = sizeof(line) - 1;
+        }
+        writer(ctx, line, n);
+
+        /* the data is escaped in pieces, each byte needs at most 4 characters */
+        unsigned char bytes[32];
+        char          text[4 * sizeof(bytes) + 1];
+        uint32_t      done = 0;
+        while (done < h.len) {
+            uint32_t cnt = h.len - done;
+            if (cnt > sizeof(bytes)) {
+                cnt = sizeof(bytes);
+            }
+            copyOut(r, pos + done, bytes, cnt);
+            char* p = text;
+            for (uint32_t i = 0; i < cnt; ++i) {
+                unsigned char c = bytes[i];
+                if (c == '\\') {
+                    *p++ = '\\';
+                    *p++ = '\\';
+                } else if (c >= 0x20 && c < 0x7f) {
+                    *p++ = c;
+                } else {
+                    p += sprintf(p, "\\x%02x", c);
+                }
+            }
+            writer(ctx, text, p - text);
+            done += cnt;
+        }
+        writer(ctx, "\n", 1);
+        pos += h.len;
+    }
+}
+
+/* -------------------------------------------------------------------------------------------- */
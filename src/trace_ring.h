@@ -0,0 +1,78 @@
+#ifndef NOCURSES_TRACE_RING_H
+#define NOCURSES_TRACE_RING_H
+
+#include "util.h"
+
+#include <stdint.h>
+
+/* -------------------------------------------------------------------------------------------- */
+
+/*
+ * Fixed-size ring of trace records, each record consists of a header with timestamp,
+ * direction and call-site tag followed by the traced bytes. Recording only copies
+ * into the preallocated buffer, the oldest records are dropped if there is no space.
+ * Records are not aligned in the buffer, headers are copied in and out. Used by the
+ * main thread only.
+ */
+
+#define TRACE_OUTPUT     0
+#define TRACE_INPUT      1
+#define TRACE_TRUNCATED  2   /* flag: only the last bytes of the data were kept */
+
+typedef struct TraceHeader
+{
+    double         time;
+    const char*    tag;      /* static string, e.g. the name of the calling function */
+    uint32_t       len;      /* bytes of data following the header */
+    uint32_t       flags;    /* TRACE_OUTPUT or TRACE_INPUT, TRACE_TRUNCATED */
+
+} TraceHeader;
+
+typedef struct TraceRing
+{
+    char*          data;
+    size_t         cap;      /* 0 if tracing is disabled */
+    uint64_t       head;     /* bytes written so far */
+    uint64_t       tail;     /* position of the oldest record */
+    uint64_t       dropped;  /* records dropped for lack of space */
+
+} TraceRing;
+
+typedef void (*TraceWriter)(void* ctx, const char* data, size_t len);
+
+/* -------------------------------------------------------------------------------------------- */
+
+#define trace_ring_init    nocurses_trace_ring_init
+#define trace_ring_free    nocurses_trace_ring_free
+#define trace_ring_clear   nocurses_trace_ring_clear
+#define trace_ring_record  nocurses_trace_ring_record
+#define trace_ring_dump    nocurses_trace_ring_dump
+
+/**
+ * Allocates the buffer with cap bytes, cap should be much larger than the header.
+ * Returns false if out of memory.
+ */
+bool trace_ring_init(TraceRing* r, size_t cap);
+
+void trace_ring_free(TraceRing* r);
+
+/**
+ * Drops all records.
+ */
+void trace_ring_clear(TraceRing* r);
+
+/**
+ * Appends a record, does nothing if the ring was not initialized.
+ */
+void trace_ring_record(TraceRing* r, double time, int dir, const char* tag,
+                       const void* data, size_t len);
+
+/**
+ * Writes all records as text lines, oldest first. Bytes that are not printable
+ * ASCII characters are written as escapes, e.g. "\x1b".
+ */
+void trace_ring_dump(const TraceRing* r, TraceWriter writer, void* ctx);
+
+/* -------------------------------------------------------------------------------------------- */
+
+#endif /* NOCURSES_TRACE_RING_H */
@@ -0,0 +1,749 @@
+#include "vterm.h"
+#include "grapheme.h"
+
+/* -------------------------------------------------------------------------------------------- */
+
+enum {
+    ST_GROUND = 0,
+    ST_ESC,
+    ST_ESC_SKIP,     /* ESC followed by an intermediate byte, e.g. charset designation */
+    ST_CSI,
+    ST_OSC,
+    ST_OSC_ESC,      /* ESC within an OSC string */
+    ST_STRING,       /* DCS, SOS, PM or APC string, ignored */
+    ST_STRING_ESC
+};
+
+#define PARAM_MAX 65535
+
+static void setBlank(ScreenCell* c, const ScreenCell* pen)
+{
+    c->text[0] = ' ';
+    c->len     = 1;
+    c->fg      = SCREEN_COLOR_DEFAULT;
+    c->bg      = pen->bg;
+    c->attrs   = 0;
+}
+
+static void blankCells(VTerm* vt, ScreenCell* c, int n)
+{
+    for (int i = 0; i < n; ++i) {
+        setBlank(c + i, &vt->pen);
+    }
+}
+
+static ScreenCell* cellAt(VTerm* vt, int x, int y)
+{
+    return vt->cells + (size_t)y * vt->cols + x;
+}
+
+static void resetPen(VTerm* vt)
+{
+    vt->pen.fg    = SCREEN_COLOR_DEFAULT;
+    vt->pen.bg    = SCREEN_COLOR_DEFAULT;
+    vt->pen.attrs = 0;
+}
+
+static void resetState(VTerm* vt)
+{
+    resetPen(vt);
+    vt->x        = 0;
+    vt->y        = 0;
+    vt->wrapnext = false;
+    vt->lastx    = -1;
+    vt->lasty    = -1;
+    vt->savedx   = 0;
+    vt->savedy   = 0;
+    vt->savedpen = vt->pen;
+    vt->top      = 0;
+    vt->bottom   = vt->rows - 1;
+    vt->modes    = VTERM_MODE_CURSOR | VTERM_MODE_AUTOWRAP;
+    vt->curshape = 0;
+    vt->titlelen = 0;
+    vt->state    = ST_GROUND;
+    vt->utf8len  = 0;
+}
+
+/* allocates cols * rows cells, returns NULL if the size is invalid or out of memory */
+static ScreenCell* allocCells(int cols, int rows)
+{
+    if (   cols <= 0 || rows <= 0 || cols > VTERM_MAX_SIZE || rows > VTERM_MAX_SIZE
+        || (size_t)cols * rows > SIZE_MAX / sizeof(ScreenCell)) 
+    {
+        return NULL;
+    }
+    return (ScreenCell*) malloc((size_t)cols * rows * sizeof(ScreenCell));
+}
+
+VTerm* vterm_new(int cols, int rows)
+{
+    VTerm* vt = (VTerm*) calloc(1, sizeof(VTerm));
+    if (!vt) {
+        return NULL;
+    }
+    vt->cols  = cols;
+    vt->rows  = rows;
+    vt->cells = allocCells(cols, rows);
+    vt->other = allocCells(cols, rows);
+    if (!vt->cells || !vt->other) {
+        free(vt->cells);
+        free(vt->other);
+        free(vt);
+        return NULL;
+    }
+    vterm_reset(vt);
+    vt->refcnt = 1;
+    return vt;
+}
+
+void vterm_retain(VTerm* vt)
+{
+    vt->refcnt += 1;
+}
+
+void vterm_release(VTerm* vt)
+{
+    if (--vt->refcnt == 0) {
+        free(vt->cells);
+        free(vt->other);
+        free(vt->input);
+        free(vt);
+    }
+}
+
+void vterm_reset(VTerm* vt)
+{
+    resetState(vt);
+    size_t n = (size_t)vt->cols * vt->rows;
+    blankCells(vt, vt->cells, n);
+    blankCells(vt, vt->other, n);
+}
+
+static void copyCells(ScreenCell* dst, int dcols, int drows,
+                      const ScreenCell* src, int scols, int srows)
+{
+    for (int y = 0; y < drows && y < srows; ++y) {
+        memcpy(dst + (size_t)y * dcols, src + (size_t)y * scols,
+               ((dcols < scols) ? dcols : scols) * sizeof(ScreenCell));
+    }
+}
+
+bool vterm_resize(VTerm* vt, int cols, int rows)
+{
+    size_t      n     = (size_t)cols * rows;
+    ScreenCell* cells = allocCells(cols, rows);
+    ScreenCell* other = allocCells(cols, rows);
+    if (!cells || !other) {
+        free(cells);
+        free(other);
+        return false;
+    }
+    blankCells(vt, cells, n);
+    blankCells(vt, other, n);
+    copyCells(cells, cols, rows, vt->cells, vt->cols, vt->rows);
+    copyCells(other, cols, rows, vt->other, vt->cols, vt->rows);
+    free(vt->cells);
+    free(vt->other);
+    vt->cells    = cells;
+    vt->other    = other;
+    vt->cols     = cols;
+    vt->rows     = rows;
+    vt->x        = (vt->x < cols) ? vt->x : cols - 1;
+    vt->y        = (vt->y < rows) ? vt->y : rows - 1;
+    vt->wrapnext = false;
+    vt->lastx    = -1;
+    vt->top      = 0;
+    vt->bottom   = rows - 1;
+    return true;
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+bool vterm_input(VTerm* vt, const char* data, size_t len)
+{
+    if (vt->inlen + len > vt->incap) {
+        size_t newcap = vt->incap ? 2 * vt->incap : 256;
+        while (newcap < vt->inlen + len) {
+            newcap *= 2;
+        }
+        char* newbuf = (char*) realloc(vt->input, newcap);
+        if (!newbuf) {
+            return false;
+        }
+        vt->input = newbuf;
+        vt->incap = newcap;
+    }
+    memcpy(vt->input + vt->inlen, data, len);
+    vt->inlen += len;
+    return true;
+}
+
+size_t vterm_take_input(VTerm* vt, void* buf, size_t len)
+{
+    size_t n = (len < vt->inlen) ? len : vt->inlen;
+    memcpy(buf, vt->input, n);
+    memmove(vt->input, vt->input + n, vt->inlen - n);
+    vt->inlen -= n;
+    return n;
+}
+
+static void reply(VTerm* vt, const char* fmt, int a, int b)
+{
+    char buf[32];
+    int  n = snprintf(buf, sizeof(buf), fmt, a, b);
+    if (n > 0) {
+        vterm_input(vt, buf, n);
+    }
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+static void moveTo(VTerm* vt, int x, int y)
+{
+    vt->x        = (x < 0) ? 0 : (x >= vt->cols) ? vt->cols - 1 : x;
+    vt->y        = (y < 0) ? 0 : (y >= vt->rows) ? vt->rows - 1 : y;
+    vt->wrapnext = false;
+}
+
+/* scrolls the rows top..bottom up by n rows (down if n is negative) */
+static void scrollRegion(VTerm* vt, int top, int bottom, int n)
+{
+    int h = bottom - top + 1;
+    if (h <= 0 || n == 0) {
+        return;
+    }
+    int    k   = (n > 0) ? n : -n;
+    size_t row = vt->cols;
+    if (k > h) {
+        k = h;
+    }
+    if (n > 0) {
+        memmove(cellAt(vt, 0, top), cellAt(vt, 0, top + k), (h - k) * row * sizeof(ScreenCell));
+        blankCells(vt, cellAt(vt, 0, bottom - k + 1), k * row);
+    } else {
+        memmove(cellAt(vt, 0, top + k), cellAt(vt, 0, top), (h - k) * row * sizeof(ScreenCell));
+        blankCells(vt, cellAt(vt, 0, top), k * row);
+    }
+}
+
+static void lineFeed(VTerm* vt)
+{
+    if (vt->y == vt->bottom) {
+        scrollRegion(vt, vt->top, vt->bottom, 1);
+    } else if (vt->y < vt->rows - 1) {
+        vt->y += 1;
+    }
+    vt->wrapnext = false;
+}
+
+static void reverseIndex(VTerm* vt)
+{
+    if (vt->y == vt->top) {
+        scrollRegion(vt, vt->top, vt->bottom, -1);
+    } else if (vt->y > 0) {
+        vt->y -= 1;
+    }
+    vt->wrapnext = false;
+}
+
+static void saveCursor(VTerm* vt)
+{
+    vt->savedx   = vt->x;
+    vt->savedy   = vt->y;
+    vt->savedpen = vt->pen;
+}
+
+static void restoreCursor(VTerm* vt)
+{
+    vt->pen = vt->savedpen;
+    moveTo(vt, vt->savedx, vt->savedy);
+}
+
+static void eraseCells(VTerm* vt, int x, int y, int n)
+{
+    if (x + n > vt->cols) {
+        n = vt->cols - x;
+    }
+    if (n > 0) {
+        blankCells(vt, cellAt(vt, x, y), n);
+    }
+}
+
+static void eraseRows(VTerm* vt, int y1, int y2)
+{
+    for (int y = y1; y < y2; ++y) {
+        eraseCells(vt, 0, y, vt->cols);
+    }
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+static void putCluster(VTerm* vt, const unsigned char* p, size_t n)
+{
+    vt->text += n;
+
+    /* a cluster that was split across writes continues the last cell */
+    if (vt->lastx >= 0) {
+        ScreenCell*   c = cellAt(vt, vt->lastx, vt->lasty);
+        unsigned char buf[SCREEN_CELL_TEXT + 16];
+        if (c->len + n <= sizeof(buf)) {
+            memcpy(buf, c->text, c->len);
+            memcpy(buf + c->len, p, n);
+            if (grapheme_length(buf, c->len + n) == c->len + n) {
+                if (c->len + n <= SCREEN_CELL_TEXT) {
+                    memcpy(c->text + c->len, p, n);
+                    c->len += n;
+                }
+                return;
+            }
+        }
+    }
+    if (vt->wrapnext) {
+        vt->x = 0;
+        lineFeed(vt);
+    }
+    size_t m = n;
+    if (m > SCREEN_CELL_TEXT) {
+        uint32_t cp;
+        int      k = utf8_decode(p, n, &cp);
+        m = (k > 0) ? k : 1;  /* keep the base character only */
+    }
+    ScreenCell* c = cellAt(vt, vt->x, vt->y);
+    memcpy(c->text, p, m);
+    c->len   = m;
+    c->fg    = vt->pen.fg;
+    c->bg    = vt->pen.bg;
+    c->attrs = vt->pen.attrs;
+    vt->lastx  = vt->x;
+    vt->lasty  = vt->y;
+    vt->printed += 1;
+    if (vt->x < vt->cols - 1) {
+        vt->x += 1;
+    } else if (vt->modes & VTERM_MODE_AUTOWRAP) {
+        vt->wrapnext = true;
+    }
+}
+
+/* prints a run of bytes without control characters */
+static void printText(VTerm* vt, const unsigned char* p, size_t len)
+{
+    unsigned char buf[4 + 256];
+    while (len > 0) {
+        size_t k = vt->utf8len;
+        size_t m = (len < sizeof(buf) - k) ? len : sizeof(buf) - k;
+        memcpy(buf, vt->utf8, k);
+        memcpy(buf + k, p, m);
+        p   += m;
+        len -= m;
+        vt->utf8len = 0;
+
+        size_t n   = k + m;
+        size_t pos = 0;
+        while (pos < n) {
+            size_t c = grapheme_length(buf + pos, n - pos);
+            if (c == 0) {
+                /* incomplete code point at the end */
+                vt->utf8len = n - pos;
+                memcpy(vt->utf8, buf + pos, vt->utf8len);
+                break;
+            }
+            putCluster(vt, buf + pos, c);
+            pos += c;
+        }
+    }
+}
+
+static void control(VTerm* vt, unsigned char c)
+{
+    switch (c) {
+        case '\r': moveTo(vt, 0, vt->y);                        break;
+        case '\n':
+        case '\v':
+        case '\f': vt->x = 0; lineFeed(vt);                     break;
+        case '\b': moveTo(vt, vt->x - 1, vt->y);                break;
+        case '\t': moveTo(vt, (vt->x / 8 + 1) * 8, vt->y);      break;
+        case '\a':                                              break;
+        default:   return;                                      /* ignored */
+    }
+    vt->sequences += 1;
+    vt->lastx      = -1;
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+static int param(VTerm* vt, int i, int dflt)
+{
+    return (i < vt->nparams && vt->params[i] > 0) ? vt->params[i] : dflt;
+}
+
+static void selectGraphics(VTerm* vt)
+{
+    if (vt->nparams == 0) {
+        resetPen(vt);
+        return;
+    }
+    for (int i = 0; i < vt->nparams; ++i) {
+        int v = vt->params[i];
+        switch (v) {
+            case 0:  resetPen(vt);                                                  break;
+            case 1:  vt->pen.attrs |=  SCREEN_ATTR_BOLD;                             break;
+            case 2:  vt->pen.attrs |=  VTERM_ATTR_DIM;                               break;
+            case 3:  vt->pen.attrs |=  VTERM_ATTR_ITALIC;                            break;
+            case 4:  vt->pen.attrs |=  SCREEN_ATTR_UNDERLINE;                        break;
+            case 5:  vt->pen.attrs |=  SCREEN_ATTR_BLINK;                            break;
+            case 7:  vt->pen.attrs |=  SCREEN_ATTR_INVERT;                           break;
+            case 22: vt->pen.attrs &= ~(SCREEN_ATTR_BOLD | VTERM_ATTR_DIM);          break;
+            case 23: vt->pen.attrs &= ~VTERM_ATTR_ITALIC;                            break;
+            case 24: vt->pen.attrs &= ~SCREEN_ATTR_UNDERLINE;                        break;
+            case 25: vt->pen.attrs &= ~SCREEN_ATTR_BLINK;                            break;
+            case 27: vt->pen.attrs &= ~SCREEN_ATTR_INVERT;                           break;
+            case 39: vt->pen.fg = SCREEN_COLOR_DEFAULT;                              break;
+            case 49: vt->pen.bg = SCREEN_COLOR_DEFAULT;                              break;
+            case 38:
+            case 48:
+                /* indexed and direct colors are skipped, the color is not changed */
+                if (i + 1 < vt->nparams && vt->params[i + 1] == 5) {
+                    i += 2;
+                } else if (i + 1 < vt->nparams && vt->params[i + 1] == 2) {
+                    i += 4;
+                }
+                break;
+            default:
+                if      (v >= 30  && v <= 37)  vt->pen.fg = v - 30;
+                else if (v >= 40  && v <= 47)  vt->pen.bg = v - 40;
+                else if (v >= 90  && v <= 97)  vt->pen.fg = v - 90;   /* bright */
+                else if (v >= 100 && v <= 107) vt->pen.bg = v - 100;
+                break;
+        }
+    }
+}
+
+static void useAltBuffer(VTerm* vt, bool alt)
+{
+    if (((vt->modes & VTERM_MODE_ALTBUFFER) != 0) == alt) {
+        return;
+    }
+    ScreenCell* c = vt->cells;
+    vt->cells = vt->other;
+    vt->other = c;
+    if (alt) {
+        saveCursor(vt);
+        vt->modes |= VTERM_MODE_ALTBUFFER;
+        eraseRows(vt, 0, vt->rows);
+    } else {
+        vt->modes &= ~VTERM_MODE_ALTBUFFER;
+        restoreCursor(vt);
+    }
+}
+
+static bool setMode(VTerm* vt, bool on)
+{
+    if (vt->prefix != '?') {
+        return vt->prefix == 0;  /* ANSI modes, e.g. insert mode, are ignored */
+    }
+    for (int i = 0; i < vt->nparams; ++i) {
+        int flag = 0;
+        switch (vt->params[i]) {
+            case 7:    flag = VTERM_MODE_AUTOWRAP;     break;
+            case 25:   flag = VTERM_MODE_CURSOR;       break;
+            case 1000: flag = VTERM_MODE_MOUSECLICK;   break;
+            case 1002: flag = VTERM_MODE_MOUSEDRAG;    break;
+            case 1003: flag = VTERM_MODE_MOUSEMOTION;  break;
+            case 1006: flag = VTERM_MODE_MOUSESGR;     break;
+            case 2004: flag = VTERM_MODE_PASTE;        break;
+            case 47:
+            case 1047:
+            case 1049: useAltBuffer(vt, on);           break;
+            default:   return false;
+        }
+        if (on) {
+            vt->modes |= flag;
+        } else {
+            vt->modes &= ~flag;
+        }
+    }
+    return true;
+}
+
+static void insertCells(VTerm* vt, int n)
+{
+    int right = vt->cols - vt->x;
+    if (n > right) {
+        n = right;
+    }
+    ScreenCell* c = cellAt(vt, vt->x, vt->y);
+    memmove(c + n, c, (right - n) * sizeof(ScreenCell));
+    blankCells(vt, c, n);
+}
+
+static void deleteCells(VTerm* vt, int n)
+{
+    int right = vt->cols - vt->x;
+    if (n > right) {
+        n = right;
+    }
+    ScreenCell* c = cellAt(vt, vt->x, vt->y);
+    memmove(c, c + n, (right - n) * sizeof(ScreenCell));
+    blankCells(vt, c + right - n, n);
+}
+
+/* returns false for unsupported sequences */
+static bool dispatchCsi(VTerm* vt, unsigned char final)
+{
+    const int n = param(vt, 0, 1);
+    if (vt->inter == ' ') {
+        if (final == 'q') {
+            vt->curshape = (vt->nparams > 0) ? vt->params[0] : 0;
+            return true;
+        }
+        return false;
+    }
+    if (vt->inter) {
+        return false;
+    }
+    if (vt->prefix == '>' || vt->prefix == '=' || vt->prefix == '<') {
+        return final == 'u' || (final == 'c' && vt->prefix != '<');  /* keyboard protocol */
+    }
+    if (vt->prefix == '?') {
+        return (final == 'h' || final == 'l') && setMode(vt, final == 'h');
+    }
+    switch (final) {
+        case 'A': moveTo(vt, vt->x, vt->y - n);                                    break;
+        case 'B': moveTo(vt, vt->x, vt->y + n);                                    break;
+        case 'C': moveTo(vt, vt->x + n, vt->y);                                    break;
+        case 'D': moveTo(vt, vt->x - n, vt->y);                                    break;
+        case 'E': moveTo(vt, 0, vt->y + n);                                        break;
+        case 'F': moveTo(vt, 0, vt->y - n);                                        break;
+        case 'G':
+        case '`': moveTo(vt, n - 1, vt->y);                                        break;
+        case 'd': moveTo(vt, vt->x, n - 1);                                        break;
+        case 'H':
+        case 'f': moveTo(vt, param(vt, 1, 1) - 1, n - 1);                          break;
+        case 'J':
+            switch ((vt->nparams > 0) ? vt->params[0] : 0) {
+                case 0:  eraseCells(vt, vt->x, vt->y, vt->cols);
+                         eraseRows(vt, vt->y + 1, vt->rows);                       break;
+                case 1:  eraseRows(vt, 0, vt->y);
+                         eraseCells(vt, 0, vt->y, vt->x + 1);                      break;
+                default: eraseRows(vt, 0, vt->rows);                               break;
+            }
+            break;
+        case 'K':
+            switch ((vt->nparams > 0) ? vt->params[0] : 0) {
+                case 0:  eraseCells(vt, vt->x, vt->y, vt->cols);                   break;
+                case 1:  eraseCells(vt, 0, vt->y, vt->x + 1);                      break;
+                default: eraseCells(vt, 0, vt->y, vt->cols);                       break;
+            }
+            break;
+        case 'X': eraseCells(vt, vt->x, vt->y, n);                                 break;
+        case '@': insertCells(vt, n);                                              break;
+        case 'P': deleteCells(vt, n);                                              break;
+        case 'L':
+            if (vt->y >= vt->top && vt->y <= vt->bottom) {
+                scrollRegion(vt, vt->y, vt->bottom, -n);
+                vt->x = 0;
+            }
+            break;
+        case 'M':
+            if (vt->y >= vt->top && vt->y <= vt->bottom) {
+                scrollRegion(vt, vt->y, vt->bottom, n);
+                vt->x = 0;
+            }
+            break;
+        case 'S': scrollRegion(vt, vt->top, vt->bottom,  n);                       break;
+        case 'T': scrollRegion(vt, vt->top, vt->bottom, -n);                       break;
+        case 'r': {
+            int top    = param(vt, 0, 1) - 1;
+            int bottom = param(vt, 1, vt->rows) - 1;
+            if (bottom >= vt->rows) {
+                bottom = vt->rows - 1;
+            }
+            if (top < bottom) {
+                vt->top    = top;
+                vt->bottom = bottom;
+                moveTo(vt, 0, 0);
+            }
+            break;
+        }
+        case 'm': selectGraphics(vt);                                              break;
+        case 'h':
+        case 'l': return setMode(vt, final == 'h');
+        case 's': saveCursor(vt);                                                  break;
+        case 'u': restoreCursor(vt);                                               break;
+        case 'n':
+            if (n == 6) {
+                reply(vt, "\x1b[%d;%dR", vt->y + 1, vt->x + 1);
+            } else if (n == 5) {
+                reply(vt, "\x1b[0n", 0, 0);
+            } else {
+                return false;
+            }
+            break;
+        case 'c': reply(vt, "\x1b[?1;2c", 0, 0);                                   break;
+        default:  return false;
+    }
+    return true;
+}
+
+static void dispatchOsc(VTerm* vt)
+{
+    vt->sequences += 1;
+    vt->osc[vt->osclen] = '\0';
+    if (vt->osc[0] == '0' || vt->osc[0] == '2') {
+        if (vt->osc[1] == ';') {
+            vt->titlelen = vt->osclen - 2;
+            if (vt->titlelen > VTERM_TITLE) {
+                vt->titlelen = VTERM_TITLE;
+            }
+            memcpy(vt->title, vt->osc + 2, vt->titlelen);
+            return;
+        }
+    } else if (vt->osc[0] == '1' && vt->osc[1] == ';') {
+        return;  /* icon name */
+    }
+    vt->unknown += 1;
+}
+
+static void dispatchEsc(VTerm* vt, unsigned char c)
+{
+    vt->sequences += 1;
+    switch (c) {
+        case '7': saveCursor(vt);                         break;
+        case '8': restoreCursor(vt);                      break;
+        case 'D': lineFeed(vt);                           break;
+        case 'E': vt->x = 0; lineFeed(vt);                break;
+        case 'M': reverseIndex(vt);                       break;
+        case 'c': vterm_reset(vt);                        break;
+        case '=':
+        case '>':                                         break;  /* keypad modes */
+        default:  vt->unknown += 1;                       break;
+    }
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+static void beginCsi(VTerm* vt)
+{
+    vt->state   = ST_CSI;
+    vt->prefix  = 0;
+    vt->inter   = 0;
+    vt->nparams = 0;
+}
+
+void vterm_write(VTerm* vt, const char* data, size_t len)
+{
+    const unsigned char* p   = (const unsigned char*) data;
+    const unsigned char* end = p + len;
+    vt->bytes += len;
+    while (p < end) {
+        unsigned char c = *p;
+        switch (vt->state) {
+            case ST_GROUND: {
+                if (c == 0x1b) {
+                    vt->state = ST_ESC;
+                    p += 1;
+                } else if (c < 0x20 || c == 0x7f) {
+                    control(vt, c);
+                    p += 1;
+                } else {
+                    const unsigned char* q = p;
+                    while (q < end && *q >= 0x20 && *q != 0x7f) {
+                        q += 1;
+                    }
+                    printText(vt, p, q - p);
+                    p = q;
+                }
+                continue;
+            }
+            case ST_ESC:
+                vt->lastx = -1;
+                vt->state = ST_GROUND;
+                if      (c == '[')                         beginCsi(vt);
+                else if (c == ']')                         { vt->state = ST_OSC; vt->osclen = 0; }
+                else if (c == 'P' || c == 'X' || c == '^' || c == '_')
+                                                           vt->state = ST_STRING;
+                else if (c >= 0x20 && c <= 0x2f)           vt->state = ST_ESC_SKIP;
+                else if (c == 0x1b)                        vt->state = ST_ESC;
+                else                                       dispatchEsc(vt, c);
+                break;
+            case ST_ESC_SKIP:
+                if (c < 0x20 || c > 0x2f) {  /* final byte */
+                    vt->sequences += 1;
+                    vt->state = ST_GROUND;
+                }
+                break;
+            case ST_CSI:
+                if (c >= '0' && c <= '9') {
+                    if (vt->nparams == 0) {
+                        vt->nparams = 1;
+                        vt->params[0] = 0;
+                    }
+                    int* v = vt->params + vt->nparams - 1;
+                    *v = (*v * 10 + (c - '0') <= PARAM_MAX) ? *v * 10 + (c - '0') : PARAM_MAX;
+                } else if (c == ';' || c == ':') {
+                    if (vt->nparams == 0) {
+                        vt->nparams = 1;
+                        vt->params[0] = 0;
+                    }
+                    if (vt->nparams < VTERM_PARAMS) {
+                        vt->params[vt->nparams++] = 0;
+                    }
+                } else if (c >= '<' && c <= '?') {
+                    vt->prefix = c;
+                } else if (c >= 0x20 && c <= 0x2f) {
+                    vt->inter = c;
+                } else if (c >= 0x40 && c <= 0x7e) {
+                    vt->sequences += 1;
+                    vt->state = ST_GROUND;
+                    if (!dispatchCsi(vt, c)) {
+                        vt->unknown += 1;
+                    }
+                } else if (c == 0x1b) {
+                    vt->state = ST_ESC;  /* sequence is aborted */
+                } else if (c == 0x18 || c == 0x1a) {
+                    vt->state = ST_GROUND;
+                } else if (c < 0x20) {
+                    control(vt, c);
+                }
+                break;
+            case ST_OSC:
+                if (c == 0x07) {
+                    dispatchOsc(vt);
+                    vt->state = ST_GROUND;
+                } else if (c == 0x1b) {
+                    vt->state = ST_OSC_ESC;
+                } else if (vt->osclen < sizeof(vt->osc) - 1) {
+                    vt->osc[vt->osclen++] = c;
+                }
+                break;
+            case ST_OSC_ESC:
+                dispatchOsc(vt);
+                vt->state = ST_GROUND;
+                if (c != '\\') {
+                    vt->state = ST_ESC;
+                    continue;  /* ESC starts the next sequence */
+                }
+                break;
+            case ST_STRING:
+                if (c == 0x1b) {
+                    vt->state = ST_STRING_ESC;
+                } else if (c == 0x07) {
+                    vt->sequences += 1;
+                    vt->unknown   += 1;
+                    vt->state = ST_GROUND;
+                }
+                break;
+            case ST_STRING_ESC:
+                vt->state = ST_STRING;
+                if (c == '\\') {
+                    vt->sequences += 1;
+                    vt->unknown   += 1;
+                    vt->state = ST_GROUND;
+                }
+                break;
+        }
+        p += 1;
+    }
+}
+
+/* -------------------------------------------------------------------------------------------- */
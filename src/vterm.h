@@ -0,0 +1,142 @@
+#ifndef NOCURSES_VTERM_H
+#define NOCURSES_VTERM_H
+
+#include "util.h"
+#include "screen_buffer.h"
+
+#include <stdint.h>
+
+/* -------------------------------------------------------------------------------------------- */
+
+/*
+ * Headless virtual terminal. Output bytes are parsed like a VT100/xterm compatible
+ * terminal would do and are applied to an in-memory cell grid, so that the output
+ * of nocurses can be checked cell by cell without a tty. All sequences of
+ * SEQUENCE_DEFINES are understood, additionally the usual cursor movement, erase,
+ * insert/delete, scrolling region and save/restore sequences.
+ *
+ * Line feeds also return the cursor to the first column, as the output processing
+ * of a tty does by default. Each cell contains one grapheme cluster, wide
+ * characters are not taken into account. Bytes and sequences are counted for
+ * measuring the output costs.
+ */
+
+#define VTERM_ATTR_DIM         0x10  /* in addition to SCREEN_ATTR_* */
+#define VTERM_ATTR_ITALIC      0x20
+
+#define VTERM_MODE_CURSOR      0x0001  /* cursor is visible */
+#define VTERM_MODE_ALTBUFFER   0x0002  /* alternate screen buffer is used */
+#define VTERM_MODE_AUTOWRAP    0x0004
+#define VTERM_MODE_MOUSECLICK  0x0008
+#define VTERM_MODE_MOUSEDRAG   0x0010
+#define VTERM_MODE_MOUSEMOTION 0x0020
+#define VTERM_MODE_MOUSESGR    0x0040
+#define VTERM_MODE_PASTE       0x0080
+
+#define VTERM_PARAMS           16
+#define VTERM_MAX_SIZE         65535  /* maximal number of columns and rows */
+#define VTERM_TITLE            256
+
+typedef struct VTerm
+{
+    int            refcnt;
+    int            cols;
+    int            rows;
+    ScreenCell*    cells;      /* displayed buffer, cols * rows */
+    ScreenCell*    other;      /* main buffer while the alternate buffer is displayed */
+
+    int            x;          /* cursor, 0-based */
+    int            y;
+    bool           wrapnext;   /* last column was written, next character wraps */
+    int            lastx;      /* cell of the last character, -1 after other output */
+    int            lasty;
+    int            savedx;
+    int            savedy;
+    ScreenCell     savedpen;
+    int            top;        /* scrolling region, 0-based, inclusive */
+    int            bottom;
+    ScreenCell     pen;        /* fg, bg and attrs of new cells */
+    int            modes;      /* VTERM_MODE_* flags */
+    int            curshape;
+    char           title[VTERM_TITLE];
+    size_t         titlelen;
+
+    /* parser */
+    int            state;
+    unsigned char  utf8[4];    /* incomplete UTF-8 sequence */
+    int            utf8len;
+    char           prefix;     /* private parameter prefix, e.g. '?' */
+    char           inter;      /* intermediate byte, e.g. ' ' */
+    int            params[VTERM_PARAMS];
+    int            nparams;
+    char           osc[VTERM_TITLE + 8];
+    size_t         osclen;
+
+    /* replies of the terminal, e.g. cursor position reports, and injected input */
+    char*          input;
+    size_t         inlen;
+    size_t         incap;
+
+    /* statistics */
+    uint64_t       bytes;      /* all bytes written */
+    uint64_t       sequences;  /* control characters and escape sequences */
+    uint64_t       text;       /* bytes of printed characters */
+    uint64_t       printed;    /* printed grapheme clusters */
+    uint64_t       unknown;    /* unsupported escape sequences */
+
+} VTerm;
+
+/* -------------------------------------------------------------------------------------------- */
+
+#define vterm_new        nocurses_vterm_new
+#define vterm_retain     nocurses_vterm_retain
+#define vterm_release    nocurses_vterm_release
+#define vterm_resize     nocurses_vterm_resize
+#define vterm_reset      nocurses_vterm_reset
+#define vterm_write      nocurses_vterm_write
+#define vterm_input      nocurses_vterm_input
+#define vterm_take_input nocurses_vterm_take_input
+
+/**
+ * Creates a virtual terminal with blank cells. The reference counter is 1.
+ * Returns NULL if out of memory or if the size exceeds VTERM_MAX_SIZE.
+ */
+VTerm* vterm_new(int cols, int rows);
+
+void vterm_retain(VTerm* vt);
+
+/**
+ * Decreases the reference counter and frees the terminal if no reference is left.
+ */
+void vterm_release(VTerm* vt);
+
+/**
+ * Changes the size, the content of the overlapping area is kept. Returns false
+ * if out of memory or if the size exceeds VTERM_MAX_SIZE.
+ */
+bool vterm_resize(VTerm* vt, int cols, int rows);
+
+/**
+ * Resets the terminal state and clears the cells, like ESC c. Statistics are kept.
+ */
+void vterm_reset(VTerm* vt);
+
+/**
+ * Parses output bytes. Sequences may be split across calls.
+ */
+void vterm_write(VTerm* vt, const char* data, size_t len);
+
+/**
+ * Appends bytes to the input that is read by terminals bound to this virtual
+ * terminal. Returns false if out of memory.
+ */
+bool vterm_input(VTerm* vt, const char* data, size_t len);
+
+/**
+ * Moves up to len bytes of input into buf, returns the number of bytes.
+ */
+size_t vterm_take_input(VTerm* vt, void* buf, size_t len);
+
+/* -------------------------------------------------------------------------------------------- */
+
+#endif /* NOCURSES_VTERM_H */